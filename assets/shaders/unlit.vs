@@ -1,15 +1,33 @@
 #version 330 core
 
-layout (location = 0) in vec3 Position;
-layout (location = 1) in vec4 VColor;
+// Packed vertex, see PackedVertex in mesher.h
+layout (location = 0) in uint Vertex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Must be at least Voxel_Types long
+uniform vec4 palette[16];
+
+// World space origin of the chunk owning each block of `arena_block`
+// vertices of the vertex arena, see Renderer. gl_VertexID includes the
+// base vertex of the chunk, so it is the vertex's index in the arena.
+uniform isamplerBuffer chunk_origins;
+uniform int arena_block;
+
+// Per frame data, see FrameUniforms in rendering.cpp
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+};
 
 out vec4 Color;
 
 void main() {
-    Color = VColor;
-    gl_Position = projection * view * model * vec4(Position, 1.0);
+    vec3 position = vec3(float(Vertex & 0x1Fu),
+                         float((Vertex >> 5) & 0x1FFu),
+                         float((Vertex >> 14) & 0x1Fu));
+    uint voxel = (Vertex >> 22) & 0xFFu;
+
+    vec3 origin = vec3(texelFetch(chunk_origins, gl_VertexID / arena_block).xyz);
+
+    Color = palette[voxel];
+    gl_Position = projection * view * vec4(origin + position - 0.5, 1.0);
 }
@@ -1,160 +1,409 @@
 #include "chunk.h"
 
 #include <vector>
-#include <glad/glad.h>
+#include <mutex>
+#include <cstring>
+#include <cassert>
 
 #include "xmath.h"
-#include "random.h"
+#include "pool.h"
+
+// Recycles the packed voxels of sections, with one free list per width
+// since sections are repacked as they are edited and chunks stream in and
+// out all the time
+class SectionWordPool {
+public:
+    ~SectionWordPool() {
+        for (auto &list : free_lists) {
+            for (auto *words : list) delete[] words;
+        }
+    }
+
+    // Returns uninitialized storage for Section_Volume voxels of `bits`
+    uint64_t *acquire(int bits) {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            auto &list = free_lists[list_index(bits)];
+            if (!list.empty()) {
+                auto *words = list.back();
+                list.pop_back();
+                return words;
+            }
+        }
+        return new uint64_t[Section_Volume * bits / 64];
+    }
+
+    void release(uint64_t *words, int bits) {
+        std::lock_guard<std::mutex> lock{mutex};
+        free_lists[list_index(bits)].push_back(words);
+    }
+
+private:
+    std::mutex mutex;
+    // 1, 2, 4 and 8 bits
+    std::vector<uint64_t *> free_lists[4];
+
+    static int list_index(int bits) {
+        assert(bits == 1 || bits == 2 || bits == 4 || bits == 8);
+        return bits == 1 ? 0 : bits == 2 ? 1 : bits == 4 ? 2 : 3;
+    }
+};
+
+// Declared first so it outlives the pooled chunks, which give back their
+// sections' storage when destroyed
+static SectionWordPool section_words;
+static Pool<Chunk> chunk_pool;
+
+Chunk *alloc_chunk(const Point3 &position) {
+    auto *chunk = chunk_pool.acquire(position);
+    chunk->position = position;
+    return chunk;
+}
 
 void unload_chunk(Chunk *chunk) {
-    delete chunk;
+    assert(!chunk->uploaded && "unload_chunk: Chunk still holds vertex arena space");
+
+    // Back to a chunk of air, keeping only the mesh capacity
+    for (auto &section : chunk->sections) section.fill(Voxel_Air);
+    chunk->mesh.vertices.clear();
+    chunk->saved = false;
+    chunk->mesh_version = 0;
+    chunk->lod = 0;
+    chunk->dirty_sections = 0;
+    chunk->uploaded_version = 0;
+
+    chunk_pool.release(chunk);
 }
 
-Chunk::Chunk(const Point3 &position) : position{position} {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &color_buffer);
+ChunkSection::~ChunkSection() {
+    if (data != nullptr) section_words.release(data, bits);
 }
 
-Chunk::~Chunk() {
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &color_buffer);
+// Returns the index of `voxel` in the palette, or -1 if it is not there
+static int palette_index(const ChunkSection &section, Voxel voxel) {
+    if (section.bits == 8) return voxel;
+
+    for (int i = 0; i < section.palette_size; ++i) {
+        if (section.palette[i] == voxel) return i;
+    }
+    return -1;
 }
 
-void Chunk::build_chunk_mesh() {
-    auto &verts = mesh.vertices;
-    verts.clear();
+void ChunkSection::resize(int new_bits) {
+    uint64_t *new_data = nullptr;
 
-    for (int x = 0; x < Chunk_SizeX; ++x) {
-        for (int y = 0; y < Chunk_SizeY; ++y) {
-            for (int z = 0; z < Chunk_SizeZ; ++z) {
-                auto voxel = voxels[x][y][z];
-                if (voxel == Voxel_Air) {
-                    continue;
-                }
+    if (new_bits > 0) {
+        new_data = section_words.acquire(new_bits);
+        memset(new_data, 0, Section_Volume * new_bits / 8);
 
-                auto pos = Vector3(float(x), float(y), float(z));
-                int n_verts = 0;
-
-                // Front face (towards +Z)
-                if (z == Chunk_SizeZ - 1 || voxels[x][y][z + 1] == Voxel_Air) {
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3( 0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f,  0.5f));
-                    n_verts += 6;
-                }
+        for (int i = 0; i < Section_Volume; ++i) {
+            // Decode with the old width and palette
+            int index = 0;
+            if (bits > 0) {
+                int bit = i * bits;
+                index = int(data[bit >> 6] >> (bit & 63)) & ((1 << bits) - 1);
+            }
+            if (new_bits == 8 && bits != 8) {
+                // Switching to raw voxels
+                index = palette[index];
+            }
 
-                // Back face (towards -Z)
-                if (z == 0 || voxels[x][y][z - 1] == Voxel_Air) {
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f, -0.5f));
-                    n_verts += 6;
-                }
+            int bit = i * new_bits;
+            new_data[bit >> 6] |= uint64_t(index) << (bit & 63);
+        }
+    }
 
-                // Left face (towards -X)
-                if (x == 0 || voxels[x - 1][y][z] == Voxel_Air) {
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f,  0.5f));
-                    n_verts += 6;
-                }
+    if (data != nullptr) section_words.release(data, bits);
+    data = new_data;
+    bits = uint8_t(new_bits);
+}
 
-                // Right face (towards +X)
-                if (x == Chunk_SizeX - 1 || voxels[x + 1][y][z] == Voxel_Air) {
-                    verts.push_back(pos + Vector3(0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3(0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(0.5f,  0.5f,  0.5f));
-                    n_verts += 6;
-                }
+void ChunkSection::set(int x, int y, int z, Voxel voxel) {
+    int index = palette_index(*this, voxel);
 
-                // Top face (towards +Y)
-                if (y == Chunk_SizeY - 1 || voxels[x][y + 1][z] == Voxel_Air) {
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3( 0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f,  0.5f, -0.5f));
-                    n_verts += 6;
-                }
+    if (index < 0) {
+        if (palette_size == 1 << bits) {
+            // Out of indices, widen to 1, 2, 4 then 8 bits per voxel
+            resize(bits == 0 ? 1 : bits * 2);
+        }
 
-                // Bottom face (towards -Y)
-                if (y == 0 || voxels[x][y - 1][z] == Voxel_Air) {
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f, -0.5f, -0.5f));
-                    verts.push_back(pos + Vector3( 0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3( 0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f,  0.5f));
-                    verts.push_back(pos + Vector3(-0.5f, -0.5f, -0.5f));
-                    n_verts += 6;
-                }
+        if (bits == 8) {
+            index = voxel;
+        } else {
+            index = palette_size++;
+            palette[index] = voxel;
+        }
+    }
 
-                for (int i = 0; i < n_verts; ++i) {
-                    mesh.colors.push_back(Voxel_ColorMap[voxel]);
-                }
-            }
+    if (bits == 0) return;
+
+    int bit = ((x * Section_Size + y) * Section_Size + z) * bits;
+    uint64_t mask = uint64_t((1 << bits) - 1) << (bit & 63);
+    data[bit >> 6] = (data[bit >> 6] & ~mask) | (uint64_t(index) << (bit & 63));
+}
+
+void ChunkSection::get_row(int x, int y, Voxel *row) const {
+    for (int z = 0; z < Section_Size; ++z) {
+        row[z] = get(x, y, z);
+    }
+}
+
+// True if all Section_Volume voxels are `voxels[0]`
+static bool all_same(const Voxel *voxels) {
+    static_assert(sizeof(Voxel) == 1, "Compares 8 voxels at a time");
+
+    uint64_t first = voxels[0] * 0x0101010101010101ull;
+    uint64_t diff = 0;
+    for (int i = 0; i < Section_Volume; i += 8) {
+        uint64_t word;
+        memcpy(&word, voxels + i, 8);
+        diff |= word ^ first;
+    }
+    return diff == 0;
+}
+
+void ChunkSection::fill(Voxel voxel) {
+    if (data != nullptr) section_words.release(data, bits);
+    data = nullptr;
+    bits = 0;
+    palette[0] = voxel;
+    palette_size = 1;
+}
+
+void ChunkSection::assign(const Voxel *voxels) {
+    fill(voxels[0]);
+
+    // Most sections are all air or all stone
+    if (all_same(voxels)) return;
+
+    // Counted afterwards, reading `used` in the loop would make every
+    // voxel wait on the store of the one before
+    bool used[256] = {};
+    for (int i = 0; i < Section_Volume; ++i) {
+        used[voxels[i]] = true;
+    }
+    int n_used = 0;
+    for (bool u : used) n_used += u;
+
+    int new_bits = 0;
+    while ((1 << new_bits) < n_used) {
+        new_bits = new_bits == 0 ? 1 : new_bits * 2;
+    }
+
+    bits = uint8_t(new_bits);
+
+    // Palette index of each voxel type
+    uint8_t index[256];
+    if (new_bits < 8) {
+        palette_size = 0;
+        for (int v = 0; v < 256; ++v) {
+            if (!used[v]) continue;
+            index[v] = palette_size;
+            palette[palette_size++] = Voxel(v);
+        }
+    } else {
+        for (int v = 0; v < 256; ++v) index[v] = uint8_t(v);
+    }
+
+    // The width divides 64 so voxels never straddle two words
+    int n_words = Section_Volume * new_bits / 64;
+    int per_word = 64 / new_bits;
+    data = section_words.acquire(new_bits);
+    for (int w = 0; w < n_words; ++w) {
+        const Voxel *src = voxels + w * per_word;
+        uint64_t word = 0;
+        for (int i = 0; i < per_word; ++i) {
+            word |= uint64_t(index[src[i]]) << (i * new_bits);
         }
+        data[w] = word;
+    }
+}
+
+void ChunkSection::compact() {
+    if (bits == 0) return;
+
+    // Rebuild with a palette of the used voxels only
+    Voxel voxels[Section_Volume];
+    for (int x = 0; x < Section_Size; ++x) {
+        for (int y = 0; y < Section_Size; ++y) {
+            get_row(x, y, &voxels[(x * Section_Size + y) * Section_Size]);
+        }
+    }
+    assign(voxels);
+}
+
+SectionKind ChunkSection::kind() const {
+    if (bits == 0) {
+        return palette[0] == Voxel_Air ? Section_Air : Section_Solid;
+    }
+    // The palette may hold voxels that are no longer used, so this is
+    // only a conservative answer, which is all the mesher needs.
+    if (palette_index(*this, Voxel_Air) < 0) {
+        return Section_Solid;
+    }
+    return Section_Mixed;
+}
+
+size_t ChunkSection::memory_usage() const {
+    return Section_Volume * bits / 8;
+}
+
+Chunk::Chunk(const Point3 &position) : position{position} {}
+
+void Chunk::compact() {
+    for (auto &section : sections) {
+        section.compact();
+    }
+}
+
+size_t Chunk::memory_usage() const {
+    size_t bytes = 0;
+    for (const auto &section : sections) {
+        bytes += section.memory_usage();
+    }
+    return bytes;
+}
+
+// Chunk::pad for the layers [first_y, end_y). Sets the kind of every
+// section overlapping them.
+static void pad_layers(const Chunk &chunk, int first_y, int end_y, PaddedVoxels *padded) {
+    auto &out = padded->voxels;
+
+    for (int y = first_y; y < end_y; ++y) {
+        memset(out[0][y], Voxel_Air, sizeof(out[0][y]));
+        memset(out[Chunk_SizeX + 1][y], Voxel_Air, sizeof(out[0][y]));
     }
 
-    const float *vbo_data = reinterpret_cast<const float *>(verts.data());
-    const float *c_data = reinterpret_cast<const float *>(mesh.colors.data());
+    for (int s = first_y / Section_Size; s * Section_Size < end_y; ++s) {
+        const auto &section = chunk.sections[s];
+        padded->sections[s] = section.kind();
 
-    glBindVertexArray(VAO);
+        int begin = math::max(first_y, s * Section_Size);
+        int end = math::min(end_y, (s + 1) * Section_Size);
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = begin; y < end; ++y) {
+                auto *row = out[x + 1][y];
+                row[0] = Voxel_Air;
+                row[Chunk_SizeZ + 1] = Voxel_Air;
+                section.get_row(x, y - s * Section_Size, row + 1);
+            }
+        }
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float) * 3, vbo_data, GL_STATIC_DRAW);
+// Chunk::pad_border at level 0 for the layers [first_y, end_y)
+static void pad_border_layers(const Chunk &chunk, Face side, int first_y, int end_y,
+                              PaddedVoxels *padded) {
+    auto &out = padded->voxels;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
+    switch (side) {
+    case Face_PosX:
+        for (int y = first_y; y < end_y; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                out[Chunk_SizeX + 1][y][z + 1] = chunk.get(0, y, z);
+            }
+        }
+        break;
+    case Face_NegX:
+        for (int y = first_y; y < end_y; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                out[0][y][z + 1] = chunk.get(Chunk_SizeX - 1, y, z);
+            }
+        }
+        break;
+    case Face_PosZ:
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = first_y; y < end_y; ++y) {
+                out[x + 1][y][Chunk_SizeZ + 1] = chunk.get(x, y, 0);
+            }
+        }
+        break;
+    case Face_NegZ:
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = first_y; y < end_y; ++y) {
+                out[x + 1][y][0] = chunk.get(x, y, Chunk_SizeZ - 1);
+            }
+        }
+        break;
+    default:
+        assert(false && "Chunk::pad_border: Chunks have no vertical neighbors");
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, color_buffer);
-    glBufferData(GL_ARRAY_BUFFER, mesh.colors.size() * sizeof(float) * 4, c_data, GL_STATIC_DRAW);
+// Layers a section's mesh is built from, the section and the layers
+// right above and below it
+static void section_layers(int section, int *first_y, int *end_y) {
+    *first_y = math::max(0, section * Section_Size - 1);
+    *end_y = math::min(Chunk_SizeY, (section + 1) * Section_Size + 1);
+}
 
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(1);
+void Chunk::pad(PaddedVoxels *padded) const {
+    pad_layers(*this, 0, Chunk_SizeY, padded);
 }
 
-Voxel make_voxel(const Vector3 &position) {
-    float noise = snoise(position);
-    if (noise > 0.3f) return Voxel_Air;
-    return Voxel_Grass;
+void Chunk::pad_section(int section, PaddedVoxels *padded) const {
+    int first_y, end_y;
+    section_layers(section, &first_y, &end_y);
+    pad_layers(*this, first_y, end_y, padded);
 }
 
-Chunk *load_chunk(const Point3 &position) {
-    auto *chunk = new Chunk{position};
-    auto world_pos = chunk->world_position();
+void Chunk::pad_section_border(Face side, int section, PaddedVoxels *padded) const {
+    int first_y, end_y;
+    section_layers(section, &first_y, &end_y);
+    pad_border_layers(*this, side, first_y, end_y, padded);
+}
 
-    for (int x = 0; x < Chunk_SizeX; ++x) {
-        for (int z = 0; z < Chunk_SizeZ; ++z) {
+// Chunk::pad_border above level 0. Blocks are downsampled exactly like
+// the interior of the neighbor's own LOD mesh, so the border matches the
+// surface the neighbor draws.
+static void pad_border_lod(const Chunk &chunk, Face side, int lod, PaddedVoxels *padded) {
+    assert(side != Face_PosY && side != Face_NegY && "Chunk::pad_border: Chunks have no vertical neighbors");
+    auto &out = padded->voxels;
+    int scale = 1 << lod;
+    bool along_x = side == Face_PosX || side == Face_NegX;
+    bool positive = side == Face_PosX || side == Face_PosZ;
 
-            auto pos = Vector2(world_pos.x, world_pos.z) + Vector2(Point2(x, z));
-            pos /= 64;
+    // Layers of the chunk sampled, and the border they are written to
+    int size = along_x ? Chunk_SizeX : Chunk_SizeZ;
+    int first = positive ? 0 : size - scale;
+    int border = positive ? size + 1 : 0;
 
-            int height = int((snoise(pos) + 1) * 16);
+    for (int y0 = 0; y0 < Chunk_SizeY; y0 += scale) {
+        const auto &section = chunk.sections[y0 / Section_Size];
 
-            for (int y = 0; y < height/2; ++y) {
-                chunk->voxels[x][y][z] = Voxel_Stone;
+        for (int a0 = 0; a0 < Section_Size; a0 += scale) {
+            Voxel voxel;
+            if (section.uniform()) {
+                voxel = section.palette[0];
+            } else {
+                int counts[Voxel_Types] = {};
+                for (int l = first; l < first + scale; ++l) {
+                    for (int y = y0; y < y0 + scale; ++y) {
+                        for (int a = a0; a < a0 + scale; ++a) {
+                            ++counts[along_x ? chunk.get(l, y, a) : chunk.get(a, y, l)];
+                        }
+                    }
+                }
+                voxel = downsample_block(counts, scale * scale * scale);
             }
 
-            for (int y = height/2; y < height; ++y) {
-                chunk->voxels[x][y][z] = Voxel_Grass;
+            for (int y = y0; y < y0 + scale; ++y) {
+                for (int a = a0; a < a0 + scale; ++a) {
+                    if (along_x) {
+                        out[border][y][a + 1] = voxel;
+                    } else {
+                        out[a + 1][y][border] = voxel;
+                    }
+                }
             }
         }
     }
-    chunk->build_chunk_mesh();
+}
 
-    return chunk;
+void Chunk::pad_border(Face side, PaddedVoxels *padded, int lod) const {
+    if (lod > 0) {
+        pad_border_lod(*this, side, lod, padded);
+    } else {
+        pad_border_layers(*this, side, 0, Chunk_SizeY, padded);
+    }
 }
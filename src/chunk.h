@@ -3,64 +3,190 @@
 
 #include <vector>
 #include <cstdint>
-#include <glad/glad.h>
 
 #include "xmath.h"
+#include "voxel.h"
+#include "mesher.h"
 
-enum Voxel : uint8_t {
-    Voxel_Air,
-    Voxel_Grass,
-    Voxel_Stone,
-};
+// A cubic section of a chunk. Voxels are stored as bit packed indices
+// into a small palette of the voxel types used by the section, using as
+// few bits per voxel as the palette allows. The width grows as more
+// types are added, up to 8 bits where voxels are stored as is. Sections
+// made of a single voxel type, such as the air above the terrain, store
+// no voxels at all.
+struct ChunkSection {
+    // Palette indices, `bits` per voxel, ordered [x][y][z] with y
+    // relative to the section. nullptr if the section is uniform.
+    uint64_t *data = nullptr;
 
-constexpr int Voxel_Types = 3;
+    // Voxel types used by the section, palette[0] fills uniform
+    // sections. Unused when `bits` is 8.
+    Voxel palette[16] = {Voxel_Air};
+    uint8_t palette_size = 1;
 
-struct Mesh {
-    std::vector<Vector3> vertices;
-    std::vector<Vector4> colors;
-};
+    // Bits per voxel: 0 (uniform), 1, 2, 4 or 8
+    uint8_t bits = 0;
+
+    ChunkSection() = default;
+
+    ChunkSection(const ChunkSection &) = delete;
+    ChunkSection &operator=(const ChunkSection &) = delete;
+
+    ~ChunkSection();
+
+    bool uniform() const { return bits == 0; }
+
+    Voxel get(int x, int y, int z) const;
+    void set(int x, int y, int z, Voxel voxel);
+
+    // Replaces the contents of the section with `voxels`, Section_Volume
+    // voxels ordered [x][y][z], using the narrowest storage they fit in.
+    void assign(const Voxel *voxels);
+
+    // Makes the section uniform, all `voxel`
+    void fill(Voxel voxel);
 
-constexpr int Chunk_SizeX = 16;
-constexpr int Chunk_SizeY = 256;
-constexpr int Chunk_SizeZ = 16;
+    // Decodes the Section_Size voxels at (x, y, 0..Section_Size - 1)
+    void get_row(int x, int y, Voxel *row) const;
 
-constexpr Vector4 Voxel_ColorMap[Voxel_Types] = {
-    {0.00f, 0.00f, 0.00f, 0.00f},
-    {0.22f, 0.54f, 0.18f, 1.00f},
-    {0.53f, 0.53f, 0.53f, 1.00f},
+    // Drops palette entries that are no longer used and narrows the
+    // storage, freeing it entirely if a single voxel type remains.
+    void compact();
+
+    SectionKind kind() const;
+
+    // Bytes allocated for the packed voxels
+    size_t memory_usage() const;
+
+private:
+    // Re-encodes the voxels with `new_bits` per voxel
+    void resize(int new_bits);
 };
 
 struct Chunk {
-    Voxel voxels[Chunk_SizeX][Chunk_SizeY][Chunk_SizeZ]{};
+    ChunkSection sections[Chunk_Sections];
     Mesh mesh;
 
     // Position in chunk space
     Point3 position;
 
-    GLuint VAO;
-    GLuint VBO;
-    GLuint color_buffer;
+    // False if the chunk has changes that are not saved to disk yet
+    bool saved = false;
+
+    // Incremented every time a new mesh is requested, so results of
+    // older mesh jobs that finish late can be told apart and dropped.
+    uint32_t mesh_version = 0;
+
+    // Level of detail the chunk is meshed at, see World::lod_level
+    uint8_t lod = 0;
+
+    // Sections with edits that are not in the mesh yet, one bit per
+    // section. See World::set_voxel.
+    uint16_t dirty_sections = 0;
+    static_assert(Chunk_Sections <= 16, "dirty_sections has one bit per section");
+
+    // mesh_version of the mesh in the vertex arena. A newer mesh is on its
+    // way while they differ.
+    uint32_t uploaded_version = 0;
+
+    // Range of the renderer's vertex arena holding the mesh, see
+    // Renderer::upload_chunk. Chunks are only drawn once uploaded.
+    bool uploaded = false;
+    uint32_t vertex_offset = 0;
+    // Vertices reserved at vertex_offset, the mesh can grow up to this
+    // in place
+    uint32_t vertex_capacity = 0;
 
     Chunk(const Point3 &position);
 
     Chunk(const Chunk &) = delete;
     Chunk &operator=(const Chunk &) = delete;
 
-    ~Chunk();
+    // Voxel at (x, y, z) in chunk space
+    Voxel get(int x, int y, int z) const;
+    void set(int x, int y, int z, Voxel voxel);
+
+    // Compacts every section, should be called after large edits
+    void compact();
 
-    void build_chunk_mesh();
+    // Bytes allocated for voxel storage
+    size_t memory_usage() const;
+
+    // Copies the voxels into the interior of `padded`, clearing its
+    // border, ready for the neighbors to be added with pad_border.
+    void pad(PaddedVoxels *padded) const;
+
+    // Copies the layer of this chunk touching its neighbor into the
+    // border of the neighbor's `padded`. `side` is the direction of this
+    // chunk from the neighbor. Above level of detail 0 the outermost
+    // 2^lod layers are downsampled instead, each block filling its part
+    // of the border, see build_lod_mesh.
+    void pad_border(Face side, PaddedVoxels *padded, int lod = 0) const;
+
+    // Same as pad and pad_border at level 0, but only for the layers the
+    // mesh of `section` is built from, see build_section_mesh
+    void pad_section(int section, PaddedVoxels *padded) const;
+    void pad_section_border(Face side, int section, PaddedVoxels *padded) const;
 
     Vector3 world_position() const;
+
+    // World space bounding box of the chunk
+    void bounds(Vector3 *min, Vector3 *max) const;
 };
 
+inline Voxel ChunkSection::get(int x, int y, int z) const {
+    if (bits == 0) return palette[0];
+
+    int i = ((x * Section_Size + y) * Section_Size + z) * bits;
+    int index = int(data[i >> 6] >> (i & 63)) & ((1 << bits) - 1);
+    return bits == 8 ? Voxel(index) : palette[index];
+}
+
+inline Voxel Chunk::get(int x, int y, int z) const {
+    return sections[y / Section_Size].get(x, y % Section_Size, z);
+}
+
+inline void Chunk::set(int x, int y, int z, Voxel voxel) {
+    sections[y / Section_Size].set(x, y % Section_Size, z, voxel);
+}
+
 inline Vector3 Chunk::world_position() const {
     return Vector3(position) * Vector3(Chunk_SizeX, Chunk_SizeY, Chunk_SizeZ);
 }
 
-Voxel make_voxel(const Vector3 &position);
+inline void Chunk::bounds(Vector3 *min, Vector3 *max) const {
+    // Voxel centers are on integer coordinates
+    *min = world_position() - 0.5f;
+    *max = *min + Vector3(Chunk_SizeX, Chunk_SizeY, Chunk_SizeZ);
+}
+
+// Returns the position of the chunk containing the voxel at `voxel`,
+// given in world voxel coordinates.
+inline Point3 chunk_position(const Point3 &voxel) {
+    auto floor_div = [](int a, int b) { return a / b - (a % b < 0); };
+    return Point3(floor_div(voxel.x, Chunk_SizeX),
+                  floor_div(voxel.y, Chunk_SizeY),
+                  floor_div(voxel.z, Chunk_SizeZ));
+}
+
+// Returns the position of the voxel at `voxel` (world voxel coordinates)
+// inside its chunk.
+inline Point3 local_position(const Point3 &voxel) {
+    auto floor_mod = [](int a, int b) { return ((a % b) + b) % b; };
+    return Point3(floor_mod(voxel.x, Chunk_SizeX),
+                  floor_mod(voxel.y, Chunk_SizeY),
+                  floor_mod(voxel.z, Chunk_SizeZ));
+}
+
+// Chunks are recycled through a pool, as they are created and destroyed
+// constantly while the player moves.
 
-Chunk *load_chunk(const Point3 &position);
+// Returns a chunk of air at `position`. Safe to call from any thread.
+Chunk *alloc_chunk(const Point3 &position);
 
+// Returns the chunk to the pool. Uploaded chunks must be released from
+// the renderer first, see Renderer::release_chunk. Safe to call from any
+// thread.
 void unload_chunk(Chunk *chunk);
 
 #endif // CHUNK_H
@@ -0,0 +1,93 @@
+#include "chunk_map.h"
+
+#include <vector>
+#include <cassert>
+
+#include "xmath.h"
+#include "random.h"
+#include "chunk.h"
+
+ChunkMap::ChunkMap(size_t capacity) {
+    size_t size = 8;
+    while (size < capacity) size *= 2;
+
+    slots.resize(size, Slot{Point3(0), nullptr});
+    mask = size - 1;
+}
+
+size_t ChunkMap::home_slot(const Point3 &position) const {
+    // Chunk coordinates are small, 21 bits per axis is plenty
+    uint64_t key = (uint64_t(uint32_t(position.x)) & 0x1FFFFF)
+                 | (uint64_t(uint32_t(position.y)) & 0x1FFFFF) << 21
+                 | (uint64_t(uint32_t(position.z)) & 0x1FFFFF) << 42;
+    return size_t(SplitMix64{key}.nexti64()) & mask;
+}
+
+Chunk *ChunkMap::find(const Point3 &position) const {
+    for (size_t i = home_slot(position);; i = (i + 1) & mask) {
+        const auto &slot = slots[i];
+        if (slot.chunk == nullptr) return nullptr;
+        if (slot.position == position) return slot.chunk;
+    }
+}
+
+void ChunkMap::insert(Chunk *chunk) {
+    assert(chunk != nullptr);
+    assert(find(chunk->position) == nullptr && "ChunkMap: Duplicate chunk");
+
+    if ((count + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    size_t i = home_slot(chunk->position);
+    while (slots[i].chunk != nullptr) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = Slot{chunk->position, chunk};
+    ++count;
+}
+
+Chunk *ChunkMap::remove(const Point3 &position) {
+    size_t i = home_slot(position);
+    for (;; i = (i + 1) & mask) {
+        if (slots[i].chunk == nullptr) return nullptr;
+        if (slots[i].position == position) break;
+    }
+
+    auto *chunk = slots[i].chunk;
+    slots[i].chunk = nullptr;
+    --count;
+
+    // Shift back entries that were displaced past the removed slot so
+    // every entry stays reachable from its home slot.
+    for (size_t j = (i + 1) & mask; slots[j].chunk != nullptr; j = (j + 1) & mask) {
+        size_t home = home_slot(slots[j].position);
+        // Distance from home to j, compared to distance from home to i
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            slots[j].chunk = nullptr;
+            i = j;
+        }
+    }
+    return chunk;
+}
+
+void ChunkMap::clear() {
+    for (auto &slot : slots) {
+        slot.chunk = nullptr;
+    }
+    count = 0;
+}
+
+void ChunkMap::grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+
+    slots.resize(old.size() * 2, Slot{Point3(0), nullptr});
+    mask = slots.size() - 1;
+    count = 0;
+
+    for (const auto &slot : old) {
+        if (slot.chunk != nullptr) insert(slot.chunk);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef CHUNK_MAP_H
+#define CHUNK_MAP_H
+
+#include <vector>
+#include <cstddef>
+
+#include "xmath.h"
+
+struct Chunk;
+
+// Hash map from chunk position to chunk. Uses open addressing with
+// linear probing and backward shift deletion, so lookups touch a few
+// adjacent slots and there are no tombstones to clean up. The table is
+// kept at most half full.
+class ChunkMap {
+public:
+    struct Slot {
+        Point3 position;
+        // nullptr if the slot is empty
+        Chunk *chunk;
+    };
+
+    // Iterates over the chunks in the map in no particular order
+    class Iterator {
+    public:
+        Iterator(const Slot *slot, const Slot *end) : slot{slot}, end{end} { skip_empty(); }
+
+        Chunk *operator*() const { return slot->chunk; }
+        Iterator &operator++() { ++slot; skip_empty(); return *this; }
+        bool operator!=(const Iterator &other) const { return slot != other.slot; }
+
+    private:
+        const Slot *slot;
+        const Slot *end;
+
+        void skip_empty() {
+            while (slot != end && slot->chunk == nullptr) ++slot;
+        }
+    };
+
+    // `capacity` is rounded up to a power of two
+    explicit ChunkMap(size_t capacity = 64);
+
+    // Returns nullptr if there is no chunk at `position`
+    Chunk *find(const Point3 &position) const;
+
+    // Adds `chunk` keyed by its position. There must not already be a
+    // chunk at the same position.
+    void insert(Chunk *chunk);
+
+    // Removes and returns the chunk at `position`, or nullptr if there
+    // was none.
+    Chunk *remove(const Point3 &position);
+
+    void clear();
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    Iterator begin() const { return {slots.data(), slots.data() + slots.size()}; }
+    Iterator end() const { return {slots.data() + slots.size(), slots.data() + slots.size()}; }
+
+private:
+    std::vector<Slot> slots;
+    size_t count = 0;
+    size_t mask;
+
+    size_t home_slot(const Point3 &position) const;
+    void grow();
+};
+
+#endif // CHUNK_MAP_H
@@ -0,0 +1,63 @@
+#include "chunk_map.h"
+
+#include <cstdio>
+#include <cassert>
+#include <vector>
+
+#include "xmath.h"
+#include "random.h"
+#include "chunk.h"
+
+void test_insert_remove() {
+    ChunkMap map{4};
+    std::vector<Chunk *> chunks;
+
+    for (int x = -20; x <= 20; ++x) {
+        for (int z = -20; z <= 20; ++z) {
+            chunks.push_back(new Chunk{Point3(x, 0, z)});
+            map.insert(chunks.back());
+        }
+    }
+    assert(map.size() == chunks.size());
+
+    for (auto *chunk : chunks) {
+        assert(map.find(chunk->position) == chunk);
+    }
+    assert(map.find(Point3(21, 0, 0)) == nullptr);
+    assert(map.find(Point3(0, 1, 0)) == nullptr);
+
+    // Remove a random half, the rest must stay reachable
+    Xorshift64 rng{7};
+    std::vector<Chunk *> kept;
+    for (auto *chunk : chunks) {
+        if (rng.nextf() < 0.5f) {
+            assert(map.remove(chunk->position) == chunk);
+            assert(map.find(chunk->position) == nullptr);
+            delete chunk;
+        } else {
+            kept.push_back(chunk);
+        }
+    }
+    assert(map.size() == kept.size());
+
+    size_t n = 0;
+    for (auto *chunk : map) {
+        assert(map.find(chunk->position) == chunk);
+        ++n;
+    }
+    assert(n == kept.size());
+
+    for (auto *chunk : kept) {
+        assert(map.remove(chunk->position) == chunk);
+        delete chunk;
+    }
+    assert(map.empty());
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_insert_remove();
+}
+
+#endif
@@ -0,0 +1,250 @@
+#include "chunk.h"
+
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+
+#include "xmath.h"
+#include "mesher.h"
+#include "terrain.h"
+
+static PaddedVoxels expected;
+static PaddedVoxels padded;
+static TerrainGenerator terrain;
+
+void test_chunk_sections() {
+    auto *chunk = terrain.generate(Point3(3, 0, -2));
+
+    // Sections above the terrain and its trees are plain air
+    Heightmap heightmap;
+    terrain.heightmap(Point2(3, -2), &heightmap);
+    int top = 0;
+    for (auto &row : heightmap.height) {
+        for (int h : row) top = math::max(top, h);
+    }
+    for (int s = (top + 8) / Section_Size + 1; s < Chunk_Sections; ++s) {
+        assert(chunk->sections[s].uniform());
+        assert(chunk->sections[s].kind() == Section_Air);
+    }
+
+    // Padding from the sections matches the voxels one by one, with air
+    // around the chunk
+    chunk->pad(&padded);
+    for (int x = 0; x < Chunk_SizeX + 2; ++x) {
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            for (int z = 0; z < Chunk_SizeZ + 2; ++z) {
+                bool inside = x > 0 && x <= Chunk_SizeX && z > 0 && z <= Chunk_SizeZ;
+                auto voxel = inside ? chunk->get(x - 1, y, z - 1) : Voxel_Air;
+                assert(padded.voxels[x][y][z] == voxel);
+            }
+        }
+    }
+
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        int n_air = 0;
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = s * Section_Size; y < (s + 1) * Section_Size; ++y) {
+                for (int z = 0; z < Chunk_SizeZ; ++z) {
+                    n_air += chunk->get(x, y, z) == Voxel_Air;
+                }
+            }
+        }
+        auto kind = n_air == Section_Volume ? Section_Air : n_air == 0 ? Section_Solid : Section_Mixed;
+
+        // Chunk sections may only be less specific than a full scan
+        assert(padded.sections[s] == kind || padded.sections[s] == Section_Mixed);
+    }
+
+    // The chunk as its own neighbor towards -Z gives its last layer
+    chunk->pad_border(Face_NegZ, &padded);
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            assert(padded.voxels[x + 1][y][0] == chunk->get(x, y, Chunk_SizeZ - 1));
+        }
+    }
+
+    unload_chunk(chunk);
+}
+
+void test_pad_section() {
+    auto *chunk = terrain.generate(Point3(2, 0, 2));
+    auto *neighbor = terrain.generate(Point3(2, 0, 3));
+    chunk->pad(&expected);
+    neighbor->pad_border(Face_PosZ, &expected);
+
+    // The section and the layers around it match a full padding
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        memset(&padded, 0xFF, sizeof(padded));
+        chunk->pad_section(s, &padded);
+        neighbor->pad_section_border(Face_PosZ, s, &padded);
+
+        int first_y = math::max(0, s * Section_Size - 1);
+        int end_y = math::min(Chunk_SizeY, (s + 1) * Section_Size + 1);
+        for (int x = 0; x < Chunk_SizeX + 2; ++x) {
+            for (int y = first_y; y < end_y; ++y) {
+                assert(memcmp(padded.voxels[x][y], expected.voxels[x][y], sizeof(padded.voxels[x][y])) == 0);
+            }
+        }
+        for (int t = math::max(0, s - 1); t <= math::min(Chunk_Sections - 1, s + 1); ++t) {
+            assert(padded.sections[t] == expected.sections[t]);
+        }
+    }
+
+    unload_chunk(chunk);
+    unload_chunk(neighbor);
+}
+
+void test_lod_border() {
+    auto *chunk = terrain.generate(Point3(-1, 0, 5));
+
+    // Each block of the border holds the downsampled block of the
+    // chunk's outermost layers on that side
+    for (int lod = 1; lod < Lod_Levels; ++lod) {
+        int scale = 1 << lod;
+        chunk->pad_border(Face_NegX, &padded, lod);
+
+        for (int y0 = 0; y0 < Chunk_SizeY; y0 += scale) {
+            for (int z0 = 0; z0 < Chunk_SizeZ; z0 += scale) {
+                int counts[Voxel_Types] = {};
+                for (int x = Chunk_SizeX - scale; x < Chunk_SizeX; ++x) {
+                    for (int y = y0; y < y0 + scale; ++y) {
+                        for (int z = z0; z < z0 + scale; ++z) {
+                            ++counts[chunk->get(x, y, z)];
+                        }
+                    }
+                }
+                Voxel voxel = downsample_block(counts, scale * scale * scale);
+
+                for (int y = y0; y < y0 + scale; ++y) {
+                    for (int z = z0; z < z0 + scale; ++z) {
+                        assert(padded.voxels[0][y][z + 1] == voxel);
+                    }
+                }
+            }
+        }
+    }
+
+    unload_chunk(chunk);
+}
+
+void test_section_edit() {
+    Chunk chunk{Point3(0)};
+    assert(chunk.sections[2].uniform());
+
+    chunk.set(1, 40, 2, Voxel_Stone);
+    assert(!chunk.sections[2].uniform());
+    assert(chunk.get(1, 40, 2) == Voxel_Stone);
+    assert(chunk.get(1, 41, 2) == Voxel_Air);
+
+    chunk.set(1, 40, 2, Voxel_Air);
+    chunk.compact();
+    assert(chunk.sections[2].uniform());
+    assert(chunk.sections[2].kind() == Section_Air);
+}
+
+void test_section_palette() {
+    ChunkSection section;
+    assert(section.memory_usage() == 0);
+
+    // Each new voxel type past the palette capacity widens the storage
+    section.set(0, 0, 0, Voxel_Stone);
+    assert(section.bits == 1);
+    section.set(1, 2, 3, Voxel_Grass);
+    assert(section.bits == 2);
+
+    // The remaining types, each in a few cells. Up to 16 types fit in 4
+    // bits, which covers every voxel type.
+    for (int i = 0; i < 3 * Section_Size; ++i) {
+        auto voxel = Voxel(Voxel_Dirt + i % (Voxel_Types - Voxel_Dirt));
+        section.set(i % Section_Size, 8 + i / Section_Size, 4, voxel);
+        assert(section.bits == (voxel == Voxel_Dirt && i == 0 ? 2 : 4));
+    }
+    assert(section.palette_size == Voxel_Types);
+
+    assert(section.get(0, 0, 0) == Voxel_Stone);
+    assert(section.get(1, 2, 3) == Voxel_Grass);
+    assert(section.get(5, 5, 5) == Voxel_Air);
+    for (int i = 0; i < 3 * Section_Size; ++i) {
+        auto voxel = Voxel(Voxel_Dirt + i % (Voxel_Types - Voxel_Dirt));
+        assert(section.get(i % Section_Size, 8 + i / Section_Size, 4) == voxel);
+    }
+
+    // Removing the extra types lets the section narrow again
+    for (int i = 0; i < 3 * Section_Size; ++i) {
+        section.set(i % Section_Size, 8 + i / Section_Size, 4, Voxel_Air);
+    }
+    section.compact();
+    assert(section.bits == 2);
+    assert(section.get(0, 0, 0) == Voxel_Stone);
+    assert(section.get(1, 2, 3) == Voxel_Grass);
+    assert(section.kind() == Section_Mixed);
+}
+
+void test_section_assign() {
+    Voxel voxels[Section_Volume];
+    memset(voxels, Voxel_Stone, sizeof(voxels));
+
+    ChunkSection section;
+    section.assign(voxels);
+    assert(section.uniform());
+    assert(section.kind() == Section_Solid);
+
+    // 5 voxel types need 4 bits each
+    for (int i = 0; i < 5; ++i) {
+        voxels[i * 97] = Voxel(Voxel_Grass + i);
+    }
+    section.assign(voxels);
+    assert(section.bits == 4);
+    for (int x = 0; x < Section_Size; ++x) {
+        for (int y = 0; y < Section_Size; ++y) {
+            for (int z = 0; z < Section_Size; ++z) {
+                assert(section.get(x, y, z) == voxels[(x * Section_Size + y) * Section_Size + z]);
+            }
+        }
+    }
+}
+
+void test_chunk_memory() {
+    auto *chunk = terrain.generate(Point3(-5, 0, 7));
+
+    // Most sections are uniform or hold a few voxel types, on average
+    // under half a bit per voxel, a sixteenth of the dense byte per voxel
+    size_t dense = Chunk_SizeX * Chunk_SizeY * Chunk_SizeZ;
+    assert(chunk->memory_usage() * 16 <= dense);
+
+    unload_chunk(chunk);
+}
+
+void test_chunk_pool() {
+    auto *chunk = alloc_chunk(Point3(1, 0, 2));
+    chunk->set(3, 40, 5, Voxel_Wood);
+    chunk->saved = true;
+    chunk->mesh.vertices.resize(400);
+    unload_chunk(chunk);
+
+    // The chunk comes back as air at its new position, with the mesh
+    // capacity kept for reuse
+    auto *reused = alloc_chunk(Point3(-4, 0, 9));
+    assert(reused == chunk);
+    assert(reused->position == Point3(-4, 0, 9));
+    assert(!reused->saved && reused->mesh_version == 0);
+    assert(reused->get(3, 40, 5) == Voxel_Air && reused->memory_usage() == 0);
+    assert(reused->mesh.vertices.empty() && reused->mesh.vertices.capacity() >= 400);
+
+    unload_chunk(reused);
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_chunk_sections();
+    test_pad_section();
+    test_lod_border();
+    test_section_edit();
+    test_section_palette();
+    test_section_assign();
+    test_chunk_memory();
+    test_chunk_pool();
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "codec.h"
+
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+#include "xmath.h"
+#include "voxel.h"
+#include "chunk.h"
+
+//
+// Run length encoding
+//
+
+// Dense voxels of a whole chunk, one block of Section_Volume voxels per
+// section as ChunkSection::assign takes them. Only the blocks of mixed
+// sections are filled.
+using SectionVoxels = Voxel[Chunk_Sections][Section_Volume];
+
+static inline int section_index(int x, int y, int z) {
+    return (x * Section_Size + y) * Section_Size + z;
+}
+
+// Each column, in [x][z] order, is a list of runs from the bottom up.
+// A run is the voxel followed by its length minus one, so a full column
+// of a single voxel is one run. Uniform sections are read as a single
+// piece of every column crossing them.
+static void rle_encode(const Chunk &chunk, const SectionVoxels &voxels,
+                       std::vector<uint8_t> *out) {
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            Voxel run = chunk.sections[0].uniform() ? chunk.sections[0].palette[0]
+                                                    : voxels[0][section_index(x, 0, z)];
+            int length = 0;
+
+            auto push = [&](Voxel voxel, int n) {
+                if (voxel != run) {
+                    out->push_back(run);
+                    out->push_back(uint8_t(length - 1));
+                    run = voxel;
+                    length = 0;
+                }
+                length += n;
+            };
+
+            for (int s = 0; s < Chunk_Sections; ++s) {
+                const auto &section = chunk.sections[s];
+                if (section.uniform()) {
+                    push(section.palette[0], Section_Size);
+                    continue;
+                }
+                for (int y = 0; y < Section_Size; ++y) {
+                    push(voxels[s][section_index(x, y, z)], 1);
+                }
+            }
+            out->push_back(run);
+            out->push_back(uint8_t(length - 1));
+        }
+    }
+}
+
+static bool rle_decode(const uint8_t *data, size_t size, Chunk *chunk) {
+    const uint8_t *end = data + size;
+
+    SectionVoxels voxels;
+
+    // Sections stay uniform, with nothing written to their block, until
+    // a second voxel type shows up in them
+    Voxel first[Chunk_Sections];
+    bool seen[Chunk_Sections] = {};
+    bool mixed[Chunk_Sections] = {};
+
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            int y = 0;
+            while (y < Chunk_SizeY) {
+                if (end - data < 2) return false;
+                auto voxel = Voxel(data[0]);
+                int length = data[1] + 1;
+                data += 2;
+
+                if (y + length > Chunk_SizeY) return false;
+
+                // One piece of the run per section it crosses
+                while (length > 0) {
+                    int s = y / Section_Size;
+                    int section_y = y % Section_Size;
+                    int n = math::min(length, Section_Size - section_y);
+                    y += n;
+                    length -= n;
+
+                    if (!mixed[s]) {
+                        if (!seen[s]) {
+                            first[s] = voxel;
+                            seen[s] = true;
+                        }
+                        if (voxel == first[s]) continue;
+
+                        // Everything before this piece was `first`
+                        mixed[s] = true;
+                        memset(voxels[s], first[s], Section_Volume);
+                    }
+
+                    Voxel *dst = &voxels[s][section_index(x, section_y, z)];
+                    for (int i = 0; i < n; ++i) {
+                        dst[i * Section_Size] = voxel;
+                    }
+                }
+            }
+        }
+    }
+    if (data != end) return false;
+
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        if (mixed[s]) {
+            chunk->sections[s].assign(voxels[s]);
+        } else {
+            chunk->sections[s].fill(first[s]);
+        }
+    }
+    return true;
+}
+
+//
+// LZ
+//
+
+// The block is a list of sequences. Each sequence is a token byte, with
+// the literal count in the high 4 bits and the match length minus
+// Lz_MinMatch in the low 4 bits, then the literals, then the match offset
+// as 2 bytes. Counts of 15 continue in extra bytes which are added until
+// one is not 255. The last sequence has literals only.
+
+constexpr int Lz_MinMatch = 4;
+constexpr int Lz_HashBits = 12;
+constexpr size_t Lz_MaxOffset = 65535;
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - Lz_HashBits);
+}
+
+static void lz_write_count(size_t count, std::vector<uint8_t> *out) {
+    for (; count >= 255; count -= 255) out->push_back(255);
+    out->push_back(uint8_t(count));
+}
+
+static void lz_write_sequence(const uint8_t *literals, size_t n_literals,
+                              size_t offset, size_t match, std::vector<uint8_t> *out) {
+    size_t extra_match = match >= Lz_MinMatch ? match - Lz_MinMatch : 0;
+    uint8_t token = uint8_t((n_literals < 15 ? n_literals : 15) << 4);
+    if (match > 0) token |= uint8_t(extra_match < 15 ? extra_match : 15);
+    out->push_back(token);
+
+    if (n_literals >= 15) lz_write_count(n_literals - 15, out);
+    out->insert(out->end(), literals, literals + n_literals);
+
+    if (match > 0) {
+        out->push_back(uint8_t(offset));
+        out->push_back(uint8_t(offset >> 8));
+        if (extra_match >= 15) lz_write_count(extra_match - 15, out);
+    }
+}
+
+void lz_compress(const uint8_t *data, size_t size, std::vector<uint8_t> *out) {
+    // Last position of each hashed 4 byte sequence, plus one
+    uint32_t table[1 << Lz_HashBits] = {};
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + Lz_MinMatch <= size) {
+        uint32_t sequence = read32(data + i);
+        uint32_t &slot = table[lz_hash(sequence)];
+        size_t candidate = slot;
+        slot = uint32_t(i + 1);
+
+        if (candidate == 0 || i - (candidate - 1) > Lz_MaxOffset
+                || read32(data + candidate - 1) != sequence) {
+            ++i;
+            continue;
+        }
+
+        size_t match_start = candidate - 1;
+        size_t length = Lz_MinMatch;
+        while (i + length < size && data[match_start + length] == data[i + length]) {
+            ++length;
+        }
+
+        lz_write_sequence(data + anchor, i - anchor, i - match_start, length, out);
+        i += length;
+        anchor = i;
+    }
+
+    lz_write_sequence(data + anchor, size - anchor, 0, 0, out);
+}
+
+static bool lz_read_count(const uint8_t *&data, const uint8_t *end, size_t *count) {
+    for (;;) {
+        if (data == end) return false;
+        uint8_t byte = *data++;
+        *count += byte;
+        if (byte != 255) return true;
+    }
+}
+
+bool lz_decompress(const uint8_t *data, size_t size, uint8_t *out, size_t out_size) {
+    const uint8_t *end = data + size;
+    size_t n = 0;
+
+    for (;;) {
+        if (data == end) return false;
+        uint8_t token = *data++;
+
+        size_t n_literals = token >> 4;
+        if (n_literals == 15 && !lz_read_count(data, end, &n_literals)) return false;
+        if (size_t(end - data) < n_literals || out_size - n < n_literals) return false;
+        memcpy(out + n, data, n_literals);
+        data += n_literals;
+        n += n_literals;
+
+        // The last sequence has no match
+        if (data == end) return n == out_size;
+
+        if (end - data < 2) return false;
+        size_t offset = data[0] | size_t(data[1]) << 8;
+        data += 2;
+
+        size_t match = token & 15;
+        if (match == 15 && !lz_read_count(data, end, &match)) return false;
+        match += Lz_MinMatch;
+
+        if (offset == 0 || offset > n || out_size - n < match) return false;
+
+        // Matches may overlap what they copy, so byte by byte
+        const uint8_t *from = out + n - offset;
+        for (size_t i = 0; i < match; ++i) {
+            out[n + i] = from[i];
+        }
+        n += match;
+    }
+}
+
+//
+// Chunks
+//
+
+// Encoded chunks start with the codec, followed by the RLE stream or by
+// the size of the RLE stream as 4 bytes and the LZ block.
+
+void encode_chunk(const Chunk &chunk, ChunkCodec codec, std::vector<uint8_t> *out) {
+    static_assert(Chunk_SizeY <= 256, "Run lengths are stored in a byte");
+
+    SectionVoxels voxels;
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        const auto &section = chunk.sections[s];
+        if (section.uniform()) continue;
+
+        for (int x = 0; x < Section_Size; ++x) {
+            for (int y = 0; y < Section_Size; ++y) {
+                section.get_row(x, y, &voxels[s][section_index(x, y, 0)]);
+            }
+        }
+    }
+
+    out->push_back(codec);
+
+    if (codec == Codec_RLE) {
+        rle_encode(chunk, voxels, out);
+        return;
+    }
+
+    // Reused by every chunk encoded on the thread
+    static thread_local std::vector<uint8_t> runs;
+    runs.clear();
+    rle_encode(chunk, voxels, &runs);
+
+    uint32_t runs_size = uint32_t(runs.size());
+    auto *bytes = reinterpret_cast<const uint8_t *>(&runs_size);
+    out->insert(out->end(), bytes, bytes + 4);
+    lz_compress(runs.data(), runs.size(), out);
+}
+
+bool decode_chunk(const uint8_t *data, size_t size, Chunk *chunk) {
+    if (size < 1) return false;
+
+    switch (data[0]) {
+    case Codec_RLE:
+        return rle_decode(data + 1, size - 1, chunk);
+    case Codec_RLE_LZ: {
+        if (size < 5) return false;
+        uint32_t runs_size;
+        memcpy(&runs_size, data + 1, 4);
+
+        // At most one run per voxel
+        if (runs_size > 2 * Chunk_SizeX * Chunk_SizeY * Chunk_SizeZ) return false;
+
+        static thread_local std::vector<uint8_t> runs;
+        runs.resize(runs_size);
+        return lz_decompress(data + 5, size - 5, runs.data(), runs.size())
+            && rle_decode(runs.data(), runs.size(), chunk);
+    }
+    default:
+        return false;
+    }
+}
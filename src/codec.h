@@ -0,0 +1,35 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct Chunk;
+
+// Chunk compression, used for chunks kept in memory while out of view
+// and for chunks saved to disk. Voxels are run length encoded along Y,
+// where terrain is a handful of long runs per column. The runs can then
+// be compressed with a small LZ77 coder in the style of LZ4, which finds
+// the run sequences repeated by neighboring columns.
+enum ChunkCodec : uint8_t {
+    Codec_RLE,
+    Codec_RLE_LZ,
+};
+
+// Appends the encoded chunk to `out`
+void encode_chunk(const Chunk &chunk, ChunkCodec codec, std::vector<uint8_t> *out);
+
+// Replaces the voxels of `chunk` with the encoded chunk in `data`.
+// Returns false if `data` is not a valid encoded chunk, leaving the
+// chunk in an unspecified state.
+bool decode_chunk(const uint8_t *data, size_t size, Chunk *chunk);
+
+// LZ4 style block compression. Appends the compressed block to `out`.
+void lz_compress(const uint8_t *data, size_t size, std::vector<uint8_t> *out);
+
+// Decompresses a block from lz_compress which must decompress to exactly
+// `out_size` bytes. Returns false if the block is malformed.
+bool lz_decompress(const uint8_t *data, size_t size, uint8_t *out, size_t out_size);
+
+#endif // CODEC_H
@@ -0,0 +1,161 @@
+#include "codec.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <vector>
+
+#include "xmath.h"
+#include "random.h"
+#include "chunk.h"
+#include "terrain.h"
+
+static TerrainGenerator terrain{3};
+
+static bool same_voxels(const Chunk &a, const Chunk &b) {
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                if (a.get(x, y, z) != b.get(x, y, z)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void test_lz() {
+    auto round_trip = [](const std::vector<uint8_t> &data) {
+        std::vector<uint8_t> packed;
+        lz_compress(data.data(), data.size(), &packed);
+
+        std::vector<uint8_t> unpacked(data.size());
+        assert(lz_decompress(packed.data(), packed.size(), unpacked.data(), unpacked.size()));
+        assert(unpacked == data);
+        return packed.size();
+    };
+
+    // Too short to match
+    round_trip({});
+    round_trip({1, 2, 3});
+
+    // Long literal runs and long overlapping matches need extra length
+    // bytes
+    std::vector<uint8_t> data;
+    Xorshift64 rng{5};
+    for (int i = 0; i < 1000; ++i) data.push_back(uint8_t(rng.nexti64()));
+    for (int i = 0; i < 5000; ++i) data.push_back(7);
+    for (int i = 0; i < 3000; ++i) data.push_back(data[i]);
+    size_t size = round_trip(data);
+    assert(size < 1100);
+
+    // Only exact sizes and well formed blocks decompress
+    std::vector<uint8_t> packed;
+    lz_compress(data.data(), data.size(), &packed);
+    std::vector<uint8_t> out(data.size() + 1);
+    assert(!lz_decompress(packed.data(), packed.size(), out.data(), data.size() + 1));
+    assert(!lz_decompress(packed.data(), packed.size(), out.data(), data.size() - 1));
+    assert(!lz_decompress(packed.data(), packed.size() - 1, out.data(), data.size()));
+}
+
+void test_chunk_codec() {
+    auto *chunk = terrain.generate(Point3(2, 0, -1));
+
+    // Add runs that do not follow the terrain
+    for (int y = 100; y < 116; ++y) {
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            chunk->set(x, y, (x * 7 + y) % Chunk_SizeZ, Voxel(Voxel_Grass + (x + y) % 6));
+        }
+    }
+    chunk->set(3, Chunk_SizeY - 1, 4, Voxel_Wood);
+
+    for (auto codec : {Codec_RLE, Codec_RLE_LZ}) {
+        std::vector<uint8_t> data;
+        encode_chunk(*chunk, codec, &data);
+
+        Chunk copy{chunk->position};
+        assert(decode_chunk(data.data(), data.size(), &copy));
+        assert(same_voxels(*chunk, copy));
+
+        // Uniform sections stay uniform
+        for (int s = 0; s < Chunk_Sections; ++s) {
+            assert(copy.sections[s].uniform() == chunk->sections[s].uniform());
+        }
+
+        // Truncated data is rejected
+        assert(!decode_chunk(data.data(), data.size() - 1, &copy));
+    }
+
+    // An empty chunk is one run per column
+    Chunk empty{Point3(0, 0, 0)};
+    std::vector<uint8_t> data;
+    encode_chunk(empty, Codec_RLE, &data);
+    assert(data.size() == 1 + 2 * Chunk_SizeX * Chunk_SizeZ);
+
+    unload_chunk(chunk);
+}
+
+template <typename F>
+static double time_ms(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Throughput is in voxels, the size of the chunk decoded
+void bench_codec() {
+    constexpr int N = 8;
+    constexpr int Repeat = 4;
+    constexpr double Chunk_MB = Chunk_SizeX * Chunk_SizeY * Chunk_SizeZ / (1024.0 * 1024.0);
+
+    TerrainGenerator generator{1};
+    std::vector<Chunk *> chunks;
+    size_t packed = 0;
+    for (int x = 0; x < N; ++x) {
+        for (int z = 0; z < N; ++z) {
+            chunks.push_back(generator.generate(Point3(x, 0, z)));
+            packed += chunks.back()->memory_usage();
+        }
+    }
+    printf("[BENCH] packed  %6zu bytes/chunk\n", packed / chunks.size());
+
+    for (auto codec : {Codec_RLE, Codec_RLE_LZ}) {
+        std::vector<std::vector<uint8_t>> encoded(chunks.size());
+        double encode = time_ms([&] {
+            for (int r = 0; r < Repeat; ++r) {
+                for (size_t i = 0; i < chunks.size(); ++i) {
+                    encoded[i].clear();
+                    encode_chunk(*chunks[i], codec, &encoded[i]);
+                }
+            }
+        });
+
+        Chunk chunk{Point3(0, 0, 0)};
+        double decode = time_ms([&] {
+            for (int r = 0; r < Repeat; ++r) {
+                for (const auto &data : encoded) decode_chunk(data.data(), data.size(), &chunk);
+            }
+        });
+
+        size_t bytes = 0;
+        for (const auto &data : encoded) bytes += data.size();
+
+        double mb = Chunk_MB * Repeat * chunks.size();
+        printf("[BENCH] %-6s  %6zu bytes/chunk encode %7.1f MB/s decode %7.1f MB/s\n",
+               codec == Codec_RLE ? "rle" : "rle+lz", bytes / chunks.size(),
+               mb / (encode / 1000.0), mb / (decode / 1000.0));
+    }
+
+    for (auto *chunk : chunks) unload_chunk(chunk);
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_lz();
+    test_chunk_codec();
+
+    bench_codec();
+}
+
+#endif
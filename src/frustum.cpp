@@ -0,0 +1,104 @@
+#include "frustum.h"
+
+#include <vector>
+#include <cstdint>
+
+#include "xmath.h"
+#include "math_simd.h"
+
+Frustum make_frustum(const Matrix4 &m) {
+    // Rows of the matrix, m is accessed [column][row]
+    Vector4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    Vector4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    Vector4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    Vector4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = r3 + r0; // Left
+    frustum.planes[1] = r3 - r0; // Right
+    frustum.planes[2] = r3 + r1; // Bottom
+    frustum.planes[3] = r3 - r1; // Top
+    frustum.planes[4] = r3 + r2; // Near
+    frustum.planes[5] = r3 - r2; // Far
+
+    // Normalizing is not required for the inside tests, but keeps the
+    // plane distances meaningful.
+    for (auto &plane : frustum.planes) {
+        plane /= math::length(Vector3(plane));
+    }
+    return frustum;
+}
+
+bool frustum_contains(const Frustum &frustum, const Vector3 &min, const Vector3 &max) {
+    for (const auto &plane : frustum.planes) {
+        // Corner of the box furthest along the plane normal
+        Vector3 p(plane.x > 0.0f ? max.x : min.x,
+                  plane.y > 0.0f ? max.y : min.y,
+                  plane.z > 0.0f ? max.z : min.z);
+
+        if (math::dot(Vector3(plane), p) + plane.w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BoundsSoA::clear() {
+    min_x.clear();
+    min_y.clear();
+    min_z.clear();
+    max_x.clear();
+    max_y.clear();
+    max_z.clear();
+}
+
+void BoundsSoA::push(const Vector3 &min, const Vector3 &max) {
+    min_x.push_back(min.x);
+    min_y.push_back(min.y);
+    min_z.push_back(min.z);
+    max_x.push_back(max.x);
+    max_y.push_back(max.y);
+    max_z.push_back(max.z);
+}
+
+void frustum_cull(const Frustum &frustum, const BoundsSoA &bounds, uint8_t *visible) {
+    size_t count = bounds.size();
+    size_t i = 0;
+
+#ifdef MATH_ARCH_SSE2
+    // For each plane the furthest corner always comes from the same
+    // arrays, so 4 boxes are tested per plane with 3 multiplies.
+    const float *xs[6], *ys[6], *zs[6];
+    for (int p = 0; p < 6; ++p) {
+        const auto &plane = frustum.planes[p];
+        xs[p] = plane.x > 0.0f ? bounds.max_x.data() : bounds.min_x.data();
+        ys[p] = plane.y > 0.0f ? bounds.max_y.data() : bounds.min_y.data();
+        zs[p] = plane.z > 0.0f ? bounds.max_z.data() : bounds.min_z.data();
+    }
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < 6; ++p) {
+            const auto &plane = frustum.planes[p];
+            __m128 d = _mm_mul_ps(_mm_loadu_ps(xs[p] + i), _mm_set1_ps(plane.x));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(ys[p] + i), _mm_set1_ps(plane.y)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(zs[p] + i), _mm_set1_ps(plane.z)));
+            d = _mm_add_ps(d, _mm_set1_ps(plane.w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        visible[i + 0] = (mask >> 0) & 1;
+        visible[i + 1] = (mask >> 1) & 1;
+        visible[i + 2] = (mask >> 2) & 1;
+        visible[i + 3] = (mask >> 3) & 1;
+    }
+#endif
+
+    for (; i < count; ++i) {
+        Vector3 min(bounds.min_x[i], bounds.min_y[i], bounds.min_z[i]);
+        Vector3 max(bounds.max_x[i], bounds.max_y[i], bounds.max_z[i]);
+        visible[i] = frustum_contains(frustum, min, max);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <vector>
+#include <cstdint>
+
+#include "xmath.h"
+
+// View frustum as 6 planes (left, right, bottom, top, near, far). Each
+// plane is stored as (a, b, c, d) with the normal pointing inside, so a
+// point p is inside the plane when dot(abc, p) + d >= 0.
+struct Frustum {
+    Vector4 planes[6];
+};
+
+// Extracts the frustum planes from a combined projection * view matrix
+// (Gribb & Hartmann). The planes are in world space.
+Frustum make_frustum(const Matrix4 &projection_view);
+
+// Returns true if the box is at least partially inside the frustum. May
+// return true for some boxes just outside the corners of the frustum.
+bool frustum_contains(const Frustum &frustum, const Vector3 &min, const Vector3 &max);
+
+// Axis aligned boxes stored with one array per component so they can
+// be tested several at a time.
+struct BoundsSoA {
+    std::vector<float> min_x, min_y, min_z;
+    std::vector<float> max_x, max_y, max_z;
+
+    void clear();
+    void push(const Vector3 &min, const Vector3 &max);
+
+    size_t size() const { return min_x.size(); }
+};
+
+// Sets visible[i] to 1 if box i is at least partially inside the
+// frustum and 0 otherwise. `visible` must hold bounds.size() elements.
+void frustum_cull(const Frustum &frustum, const BoundsSoA &bounds, uint8_t *visible);
+
+#endif // FRUSTUM_H
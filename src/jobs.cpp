@@ -0,0 +1,88 @@
+#include "jobs.h"
+
+#include <thread>
+#include <mutex>
+#include <cassert>
+
+#include "xmath.h"
+
+JobSystem::~JobSystem() {
+    stop();
+}
+
+void JobSystem::start(int n_threads) {
+    assert(workers.empty() && "JobSystem: Already started");
+
+    if (n_threads == 0) {
+        n_threads = math::max(int(std::thread::hardware_concurrency()) - 1, 1);
+    }
+
+    stopping = false;
+    for (int i = 0; i < n_threads; ++i) {
+        workers.emplace_back(&JobSystem::worker_main, this);
+    }
+}
+
+void JobSystem::stop() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    job_ready.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void JobSystem::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        if (queue_size == queue.size()) {
+            // Unroll the ring into a bigger one
+            std::vector<Job> bigger(math::max<size_t>(queue.size() * 2, 64));
+            for (size_t i = 0; i < queue_size; ++i) {
+                bigger[i] = std::move(queue[(queue_head + i) % queue.size()]);
+            }
+            queue.swap(bigger);
+            queue_head = 0;
+        }
+
+        queue[(queue_head + queue_size) % queue.size()] = std::move(job);
+        ++queue_size;
+        ++pending;
+    }
+    job_ready.notify_one();
+}
+
+void JobSystem::wait() {
+    std::unique_lock<std::mutex> lock{mutex};
+    jobs_done.wait(lock, [this] { return pending == 0; });
+}
+
+void JobSystem::worker_main() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            job_ready.wait(lock, [this] { return stopping || queue_size > 0; });
+
+            if (queue_size == 0) {
+                // Only reached when stopping
+                return;
+            }
+            job = std::move(queue[queue_head]);
+            queue_head = (queue_head + 1) % queue.size();
+            --queue_size;
+        }
+
+        job();
+
+        std::lock_guard<std::mutex> lock{mutex};
+        if (--pending == 0) {
+            jobs_done.notify_all();
+        }
+    }
+}
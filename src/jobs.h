@@ -0,0 +1,131 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+// Fixed pool of worker threads consuming a FIFO queue of jobs. Jobs must
+// not touch any OpenGL state, only the main thread owns the context.
+class JobSystem {
+public:
+    // Bytes available for the captures of a job
+    static constexpr size_t Job_Capacity = 48;
+
+    // A callable stored inline rather than on the heap like a
+    // std::function, so submitting jobs never allocates. Jobs are
+    // submitted for every chunk streamed in and every remesh.
+    class Job {
+    public:
+        Job() = default;
+
+        template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, Job>::value>>
+        Job(F &&f) {
+            using T = std::decay_t<F>;
+            static_assert(sizeof(T) <= Job_Capacity, "Job: Captures too large");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "Job: Captures over aligned");
+
+            new (storage) T(std::forward<F>(f));
+            ops = &Ops<T>::table;
+        }
+
+        Job(Job &&other) noexcept { take(other); }
+
+        Job &operator=(Job &&other) noexcept {
+            if (this != &other) {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+
+        Job(const Job &) = delete;
+        Job &operator=(const Job &) = delete;
+
+        ~Job() { reset(); }
+
+        void operator()() { ops->invoke(storage); }
+
+    private:
+        struct Table {
+            void (*invoke)(void *);
+            // Move constructs into the first storage and destroys the
+            // second
+            void (*relocate)(void *, void *);
+            void (*destroy)(void *);
+        };
+
+        template <typename T>
+        struct Ops {
+            static void invoke(void *p) { (*static_cast<T *>(p))(); }
+            static void relocate(void *dst, void *src) {
+                new (dst) T(std::move(*static_cast<T *>(src)));
+                static_cast<T *>(src)->~T();
+            }
+            static void destroy(void *p) { static_cast<T *>(p)->~T(); }
+
+            static constexpr Table table = {invoke, relocate, destroy};
+        };
+
+        alignas(std::max_align_t) unsigned char storage[Job_Capacity];
+        const Table *ops = nullptr;
+
+        void take(Job &other) {
+            if (other.ops == nullptr) return;
+            other.ops->relocate(storage, other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+
+        void reset() {
+            if (ops != nullptr) ops->destroy(storage);
+            ops = nullptr;
+        }
+    };
+
+    JobSystem() = default;
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem();
+
+    // Starts `n_threads` workers. If `n_threads` is 0 one worker is
+    // started per hardware thread, leaving one for the main thread.
+    void start(int n_threads = 0);
+
+    // Finishes all queued jobs then joins the workers.
+    void stop();
+
+    void submit(Job job);
+
+    // Blocks until every submitted job has completed.
+    void wait();
+
+    int thread_count() const { return int(workers.size()); }
+
+private:
+    std::vector<std::thread> workers;
+
+    // Ring buffer of queued jobs, grown when full but never shrunk
+    std::vector<Job> queue;
+    size_t queue_head = 0;
+    size_t queue_size = 0;
+
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable jobs_done;
+
+    // Jobs that are queued or running
+    int pending = 0;
+    bool stopping = false;
+
+    void worker_main();
+};
+
+#endif // JOBS_H
@@ -122,12 +122,17 @@ int main(void) {
             camera.position.y -= velocity;
 
         world->player_position = camera.position;
+        world->update();
         world->renderer.draw(world);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    // Saves the chunks still loaded, while the context is still current
+    delete world;
+    world = nullptr;
+
     glfwTerminate();
     return 0;
 }
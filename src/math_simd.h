@@ -16,6 +16,7 @@
 #ifdef MATH_ARCH_SSE2
 
 #include <xmmintrin.h>
+#include <emmintrin.h>
 
 #include "vec.h"
 
@@ -3,6 +3,8 @@
 #include <cassert>
 
 #include "xmath.h"
+#include "frustum.h"
+#include "random.h"
 
 using namespace math;
 
@@ -77,6 +79,42 @@ void test_mat_operators() {
     assert((m1 * m2 == m1m2_mul));
 }
 
+void test_frustum() {
+    auto projection = perspective(radians(60.0f), 800.f/600.f, 0.1f, 100.0f);
+    auto view = lookat(Vector3(0.0f), Vector3(0.0f, 0.0f, -1.0f), Vector3(0.0f, 1.0f, 0.0f));
+    auto frustum = make_frustum(projection * view);
+
+    // In front, behind, past the far plane and off to the side
+    assert(frustum_contains(frustum, Vector3(-1, -1, -11), Vector3(1, 1, -9)));
+    assert(!frustum_contains(frustum, Vector3(-1, -1, 9), Vector3(1, 1, 11)));
+    assert(!frustum_contains(frustum, Vector3(-1, -1, -111), Vector3(1, 1, -109)));
+    assert(!frustum_contains(frustum, Vector3(99, -1, -11), Vector3(101, 1, -9)));
+
+    // Straddling the near plane
+    assert(frustum_contains(frustum, Vector3(-1, -1, -1), Vector3(1, 1, 1)));
+
+    // The batched test must agree with the single box test, including
+    // the tail that does not fill a whole SIMD group.
+    Xorshift64 rng{3};
+    BoundsSoA bounds;
+    for (int i = 0; i < 103; ++i) {
+        auto min = rng.next3(Vector3(-120.0f), Vector3(120.0f));
+        bounds.push(min, min + rng.next3(Vector3(1.0f), Vector3(16.0f)));
+    }
+
+    uint8_t visible[103];
+    frustum_cull(frustum, bounds, visible);
+
+    int n_visible = 0;
+    for (int i = 0; i < 103; ++i) {
+        Vector3 min(bounds.min_x[i], bounds.min_y[i], bounds.min_z[i]);
+        Vector3 max(bounds.max_x[i], bounds.max_y[i], bounds.max_z[i]);
+        assert(visible[i] == frustum_contains(frustum, min, max));
+        n_visible += visible[i];
+    }
+    assert(n_visible > 0 && n_visible < 103);
+}
+
 #ifdef TEST
 
 int main(int, char *[]) {
@@ -84,6 +122,7 @@ int main(int, char *[]) {
     test_operators<float>();
     test_mat_operators();
     test_swizzle();
+    test_frustum();
 }
 
 #endif
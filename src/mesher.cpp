@@ -0,0 +1,501 @@
+#include "mesher.h"
+
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "xmath.h"
+#include "math_simd.h"
+#include "voxel.h"
+
+// Emits the quad p0, p1, p2, p3 (counter-clockwise when seen from
+// outside the face). The triangles are formed by the shared quad index
+// buffer, see Renderer::upload_chunk.
+static void push_quad(Mesh *mesh, const Point3 (&p)[4], Face face, Voxel voxel) {
+    mesh->vertices.push_back(pack_vertex(p[0], face, voxel));
+    mesh->vertices.push_back(pack_vertex(p[1], face, voxel));
+    mesh->vertices.push_back(pack_vertex(p[2], face, voxel));
+    mesh->vertices.push_back(pack_vertex(p[3], face, voxel));
+}
+
+// Returns true if the section cannot have any visible faces
+static bool section_hidden(const PaddedVoxels &padded, int section) {
+    switch (padded.sections[section]) {
+    case Section_Air:
+        return true;
+    case Section_Mixed:
+        return false;
+    case Section_Solid:
+        break;
+    }
+
+    // Solid sections are hidden when every voxel around them is solid.
+    // The top and bottom of the chunk count as open.
+    if (section == 0 || padded.sections[section - 1] != Section_Solid) return false;
+    if (section == Chunk_Sections - 1 || padded.sections[section + 1] != Section_Solid) return false;
+
+    auto &voxels = padded.voxels;
+    for (int y = section * Section_Size; y < (section + 1) * Section_Size; ++y) {
+        for (int i = 1; i <= Section_Size; ++i) {
+            if (voxels[0][y][i] == Voxel_Air || voxels[Chunk_SizeX + 1][y][i] == Voxel_Air
+                    || voxels[i][y][0] == Voxel_Air || voxels[i][y][Chunk_SizeZ + 1] == Voxel_Air) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void build_naive_section(const PaddedVoxels &padded, int section, Mesh *mesh) {
+    auto &voxels = padded.voxels;
+
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = section * Section_Size; y < (section + 1) * Section_Size; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                // Offset by the padding
+                int px = x + 1;
+                int pz = z + 1;
+
+                auto voxel = voxels[px][y][pz];
+                if (voxel == Voxel_Air) {
+                    continue;
+                }
+
+                // Corners are in voxel corner space, (x, y, z) being the
+                // corner with the smallest coordinates.
+                auto p = Point3(x, y, z);
+
+                // Front face (towards +Z)
+                if (voxels[px][y][pz + 1] == Voxel_Air) {
+                    push_quad(mesh, {p + Point3(0, 0, 1), p + Point3(1, 0, 1),
+                                     p + Point3(1, 1, 1), p + Point3(0, 1, 1)},
+                              Face_PosZ, voxel);
+                }
+
+                // Back face (towards -Z)
+                if (voxels[px][y][pz - 1] == Voxel_Air) {
+                    push_quad(mesh, {p + Point3(0, 0, 0), p + Point3(0, 1, 0),
+                                     p + Point3(1, 1, 0), p + Point3(1, 0, 0)},
+                              Face_NegZ, voxel);
+                }
+
+                // Left face (towards -X)
+                if (voxels[px - 1][y][pz] == Voxel_Air) {
+                    push_quad(mesh, {p + Point3(0, 0, 0), p + Point3(0, 0, 1),
+                                     p + Point3(0, 1, 1), p + Point3(0, 1, 0)},
+                              Face_NegX, voxel);
+                }
+
+                // Right face (towards +X)
+                if (voxels[px + 1][y][pz] == Voxel_Air) {
+                    push_quad(mesh, {p + Point3(1, 0, 0), p + Point3(1, 1, 0),
+                                     p + Point3(1, 1, 1), p + Point3(1, 0, 1)},
+                              Face_PosX, voxel);
+                }
+
+                // Top face (towards +Y)
+                if (y == Chunk_SizeY - 1 || voxels[px][y + 1][pz] == Voxel_Air) {
+                    push_quad(mesh, {p + Point3(0, 1, 0), p + Point3(0, 1, 1),
+                                     p + Point3(1, 1, 1), p + Point3(1, 1, 0)},
+                              Face_PosY, voxel);
+                }
+
+                // Bottom face (towards -Y)
+                if (y == 0 || voxels[px][y - 1][pz] == Voxel_Air) {
+                    push_quad(mesh, {p + Point3(0, 0, 0), p + Point3(1, 0, 0),
+                                     p + Point3(1, 0, 1), p + Point3(0, 0, 1)},
+                              Face_NegY, voxel);
+                }
+            }
+        }
+    }
+}
+
+// A cubic box of voxels meshed by greedy_box, inside an array padded on
+// the X and Z sides such as PaddedVoxels or LodVoxels
+struct GreedyBox {
+    // Voxel at the smallest corner of the box
+    const Voxel *data;
+    // Strides of each axis in the flattened array
+    int strides[3];
+    // Voxels per side, at most Section_Size
+    int size;
+    // Layer of the array the box starts at and height of the array.
+    // Faces at the bottom and top of the array are always visible, there
+    // is no padding along Y.
+    int base_y;
+    int height;
+    // Chunk voxels per voxel of the array, corners are scaled by it so
+    // the mesh is always in chunk corner space
+    int scale;
+};
+
+// Emits the quad covering w by h faces from (i, j) of a slice of the box,
+// i being along axis (d + 1) % 3 and j along axis (d + 2) % 3
+static void push_rect(const GreedyBox &box, int d, int dir, int slice, int i, int j,
+                      int w, int h, Voxel voxel, Mesh *mesh) {
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+    auto face = Face(2 * d + (dir < 0));
+
+    Point3 origin;
+    origin[d] = dir > 0 ? slice + 1 : slice;
+    origin[u] = i;
+    origin[v] = j;
+    origin.y += box.base_y;
+    origin = origin * box.scale;
+
+    Point3 du = Point3(0);
+    Point3 dv = Point3(0);
+    du[u] = w * box.scale;
+    dv[v] = h * box.scale;
+
+    if (dir > 0) {
+        push_quad(mesh, {origin, origin + du, origin + du + dv, origin + dv}, face, voxel);
+    } else {
+        push_quad(mesh, {origin, origin + dv, origin + du + dv, origin + du}, face, voxel);
+    }
+}
+
+// Slices are covered from one bit mask per row of a box, in 16 bits.
+// The binary mesher adds the padding to its rows, in 32 bits.
+static_assert(Section_Size == 16, "Greedy meshing works on 16 bit rows");
+
+// Index of the lowest set bit, `bits` must not be zero
+static inline int lowest_bit(uint32_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return int(index);
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+// Covers the visible faces of one slice of the box with rectangles of a
+// single voxel type, rows before columns. Bit i of rows[j] is set if the
+// face at (i, j) is visible, bits are cleared as they are covered. Empty
+// parts of the slice are skipped a row at a time, voxel types are only
+// read to split runs of visible faces.
+static void cover_slice(const GreedyBox &box, int d, int dir, int slice,
+                        uint16_t (&rows)[Section_Size], Mesh *mesh) {
+    int N = box.size;
+    int stride_u = box.strides[(d + 1) % 3];
+    int stride_v = box.strides[(d + 2) % 3];
+    const Voxel *base = box.data + slice * box.strides[d];
+
+    for (int j = 0; j < N; ++j) {
+        while (rows[j] != 0) {
+            uint32_t bits = rows[j];
+            int i = lowest_bit(bits);
+            const Voxel *p = base + i * stride_u + j * stride_v;
+            Voxel voxel = *p;
+
+            // Longest run of visible faces, cut at the first other type
+            int run = lowest_bit(~(bits >> i));
+            int w = 1;
+            while (w < run && p[w * stride_u] == voxel) {
+                ++w;
+            }
+            uint32_t span = ((1u << w) - 1) << i;
+
+            int h = 1;
+            for (; j + h < N; ++h) {
+                if ((rows[j + h] & span) != span) break;
+
+                const Voxel *q = p + h * stride_v;
+                int k = 0;
+                while (k < w && q[k * stride_u] == voxel) {
+                    ++k;
+                }
+                if (k < w) break;
+            }
+
+            for (int l = 0; l < h; ++l) {
+                rows[j + l] &= uint16_t(~span);
+            }
+            push_rect(box, d, dir, slice, i, j, w, h, voxel, mesh);
+        }
+    }
+}
+
+// Greedy meshing based on the method described by Mikola Lysenko in
+// "Meshing in a Minecraft Game". Each axis of the box is swept one slice
+// at a time, the exposed faces in the slice are written to a bit mask per
+// row and the masks are then covered with the largest rectangles of a
+// single voxel type. Quads do not extend across boxes.
+static void greedy_box(const GreedyBox &box, Mesh *mesh) {
+    int size = box.size;
+
+    for (int d = 0; d < 3; ++d) {
+        int u = (d + 1) % 3;
+        int v = (d + 2) % 3;
+
+        for (int dir = -1; dir <= 1; dir += 2) {
+            // Offset from a voxel to its neighbor in front of the face
+            int step = dir * box.strides[d];
+
+            for (int slice = 0; slice < size; ++slice) {
+                int y = box.base_y + slice + dir;
+                bool border = d == 1 && (y < 0 || y >= box.height);
+
+                // Build the masks of faces visible from `dir` in this slice
+                uint16_t rows[Section_Size] = {};
+                for (int j = 0; j < size; ++j) {
+                    const Voxel *row = box.data + slice * box.strides[d] + j * box.strides[v];
+                    uint32_t bits = 0;
+                    for (int i = 0; i < size; ++i) {
+                        const Voxel *p = row + i * box.strides[u];
+                        bool visible = *p != Voxel_Air && (border || p[step] == Voxel_Air);
+                        bits |= uint32_t(visible) << i;
+                    }
+                    rows[j] = uint16_t(bits);
+                }
+
+                cover_slice(box, d, dir, slice, rows, mesh);
+            }
+        }
+    }
+}
+
+// Neighbors in the sections above and below are part of the same array,
+// neighbors on the X and Z sides are read from the padding.
+static GreedyBox section_box(const PaddedVoxels &padded, int section) {
+    GreedyBox box;
+    box.data = &padded.voxels[1][section * Section_Size][1];
+    box.strides[0] = Chunk_SizeY * (Chunk_SizeZ + 2);
+    box.strides[1] = Chunk_SizeZ + 2;
+    box.strides[2] = 1;
+    box.size = Section_Size;
+    box.base_y = section * Section_Size;
+    box.height = Chunk_SizeY;
+    box.scale = 1;
+    return box;
+}
+
+static void build_greedy_section(const PaddedVoxels &padded, int section, Mesh *mesh) {
+    greedy_box(section_box(padded, section), mesh);
+}
+
+// Solid voxels of a row of PaddedVoxels along Z, padding included: bit
+// z + 1 is set if the voxel at z is solid, for z from -1 to Chunk_SizeZ
+static uint32_t solid_row(const Voxel *row) {
+#ifdef MATH_ARCH_SSE2
+    // Two overlapping loads cover the 18 voxels of the row
+    __m128i air = _mm_setzero_si128();
+    auto lo = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)row), air)));
+    auto hi = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + 2)), air)));
+    return ~(lo | hi << 2) & ((1u << (Chunk_SizeZ + 2)) - 1);
+#else
+    uint32_t bits = 0;
+    for (int z = 0; z < Chunk_SizeZ + 2; ++z) {
+        bits |= uint32_t(row[z] != Voxel_Air) << z;
+    }
+    return bits;
+#endif
+}
+
+// Transposes a 16x16 bit matrix, bit i of rows[j] moving to bit j of
+// rows[i], by swapping ever smaller blocks as in Hacker's Delight 7-3
+static void transpose16(uint16_t (&rows)[16]) {
+    uint32_t mask = 0x00FF;
+    for (int j = 8; j != 0; j >>= 1, mask ^= mask << j) {
+        for (int k = 0; k < 16; k = ((k | j) + 1) & ~j) {
+            uint32_t t = ((uint32_t(rows[k]) >> j) ^ rows[k | j]) & mask;
+            rows[k] = uint16_t(rows[k] ^ t << j);
+            rows[k | j] = uint16_t(rows[k | j] ^ t);
+        }
+    }
+}
+
+// Binary greedy meshing. Each row of the section along Z is turned into a
+// bit mask of its solid voxels, after which the visible faces of a whole
+// row are found at once with shifts and AND-NOT against the neighboring
+// rows, instead of testing every voxel against each of its neighbors.
+// Faces along X and Z are transposed so every slice has its rows along the
+// same axis as greedy_box, which makes the output identical to it.
+static void build_binary_section(const PaddedVoxels &padded, int section, Mesh *mesh) {
+    constexpr int N = Section_Size;
+    int base_y = section * N;
+    auto &voxels = padded.voxels;
+
+    // solid[x + 1][y + 1] is the row at (x, base_y + y), from -1 to N on
+    // both axes. Layers above and below the chunk are air, the corners
+    // are never read.
+    uint32_t solid[N + 2][N + 2];
+    for (int x = 0; x < N + 2; ++x) {
+        for (int y = 0; y < N + 2; ++y) {
+            int vy = base_y + y - 1;
+            bool corner = (x == 0 || x == N + 1) && (y == 0 || y == N + 1);
+            solid[x][y] = corner || vy < 0 || vy >= Chunk_SizeY ? 0 : solid_row(voxels[x][vy]);
+        }
+    }
+
+    // Visible faces, planes[face][slice][j] holding bit i for the face at
+    // (i, j) of the slice, axes ordered as in greedy_box
+    uint16_t planes[6][N][N];
+    uint16_t z_faces[2][N][N];
+    for (int x = 0; x < N; ++x) {
+        for (int y = 0; y < N; ++y) {
+            uint32_t s = solid[x + 1][y + 1];
+            // Dropping the padding bits leaves bit z for the face at z
+            planes[Face_PosX][x][y] = uint16_t((s & ~solid[x + 2][y + 1]) >> 1);
+            planes[Face_NegX][x][y] = uint16_t((s & ~solid[x][y + 1]) >> 1);
+            planes[Face_PosY][y][x] = uint16_t((s & ~solid[x + 1][y + 2]) >> 1);
+            planes[Face_NegY][y][x] = uint16_t((s & ~solid[x + 1][y]) >> 1);
+            z_faces[0][y][x] = uint16_t((s & ~(s >> 1)) >> 1);
+            z_faces[1][y][x] = uint16_t((s & ~(s << 1)) >> 1);
+        }
+    }
+
+    // X slices have their rows along Z and bits along Y, Z slices their
+    // rows along Y and bits along X
+    for (int i = 0; i < N; ++i) {
+        transpose16(planes[Face_PosX][i]);
+        transpose16(planes[Face_NegX][i]);
+        transpose16(z_faces[0][i]);
+        transpose16(z_faces[1][i]);
+    }
+    for (int z = 0; z < N; ++z) {
+        for (int y = 0; y < N; ++y) {
+            planes[Face_PosZ][z][y] = z_faces[0][y][z];
+            planes[Face_NegZ][z][y] = z_faces[1][y][z];
+        }
+    }
+
+    auto box = section_box(padded, section);
+    for (int d = 0; d < 3; ++d) {
+        for (int dir = -1; dir <= 1; dir += 2) {
+            auto face = Face(2 * d + (dir < 0));
+            for (int slice = 0; slice < N; ++slice) {
+                cover_slice(box, d, dir, slice, planes[face][slice], mesh);
+            }
+        }
+    }
+}
+
+void build_section_mesh(const PaddedVoxels &padded, int section, Mesher mesher, Mesh *mesh) {
+    if (section_hidden(padded, section)) return;
+
+    switch (mesher) {
+    case Mesher_Naive:
+        build_naive_section(padded, section, mesh);
+        break;
+    case Mesher_Greedy:
+        build_greedy_section(padded, section, mesh);
+        break;
+    case Mesher_Binary:
+        build_binary_section(padded, section, mesh);
+        break;
+    }
+}
+
+// A chunk downsampled for build_lod_mesh, laid out like PaddedVoxels with
+// room for level 1. Higher levels only use the start of each axis.
+struct LodVoxels {
+    Voxel voxels[Chunk_SizeX / 2 + 2][Chunk_SizeY / 2][Chunk_SizeZ / 2 + 2];
+};
+
+Voxel downsample_block(const int (&counts)[Voxel_Types], int total) {
+    if (2 * (total - counts[Voxel_Air]) < total) return Voxel_Air;
+
+    int best = Voxel_Air + 1;
+    for (int v = best + 1; v < Voxel_Types; ++v) {
+        if (counts[v] > counts[best]) best = v;
+    }
+    return Voxel(best);
+}
+
+// Downsamples the interior of `padded` into `out` and copies the border,
+// which the neighbors already hold downsampled, one voxel per block
+static void downsample_padded(const PaddedVoxels &padded, int lod, LodVoxels *out) {
+    int scale = 1 << lod;
+    int size_x = Chunk_SizeX >> lod;
+    int size_y = Chunk_SizeY >> lod;
+    int size_z = Chunk_SizeZ >> lod;
+    int section_layers = Section_Size >> lod;
+    auto &voxels = padded.voxels;
+    auto &lod_voxels = out->voxels;
+
+    for (int y = 0; y < size_y; ++y) {
+        int fy = y * scale;
+        for (int z = 0; z < size_z; ++z) {
+            lod_voxels[0][y][z + 1] = voxels[0][fy][z * scale + 1];
+            lod_voxels[size_x + 1][y][z + 1] = voxels[Chunk_SizeX + 1][fy][z * scale + 1];
+        }
+        for (int x = 0; x < size_x; ++x) {
+            lod_voxels[x + 1][y][0] = voxels[x * scale + 1][fy][0];
+            lod_voxels[x + 1][y][size_z + 1] = voxels[x * scale + 1][fy][Chunk_SizeZ + 1];
+        }
+    }
+
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        for (int x = 0; x < size_x; ++x) {
+            for (int y = s * section_layers; y < (s + 1) * section_layers; ++y) {
+                auto *row = &lod_voxels[x + 1][y][1];
+
+                // Uniform sections need no counting
+                if (padded.sections[s] == Section_Air) {
+                    memset(row, Voxel_Air, size_t(size_z));
+                    continue;
+                }
+
+                for (int z = 0; z < size_z; ++z) {
+                    int counts[Voxel_Types] = {};
+                    for (int dx = 0; dx < scale; ++dx) {
+                        for (int dy = 0; dy < scale; ++dy) {
+                            const Voxel *fine = &voxels[x * scale + dx + 1][y * scale + dy][z * scale + 1];
+                            for (int dz = 0; dz < scale; ++dz) {
+                                ++counts[fine[dz]];
+                            }
+                        }
+                    }
+                    row[z] = downsample_block(counts, scale * scale * scale);
+                }
+            }
+        }
+    }
+}
+
+void build_lod_mesh(const PaddedVoxels &padded, int lod, Mesh *mesh) {
+    assert(lod > 0 && lod < Lod_Levels);
+    mesh->vertices.clear();
+
+    // About 13 KB, kept per thread like the mesh scratch of the jobs
+    static thread_local LodVoxels lod_voxels;
+    downsample_padded(padded, lod, &lod_voxels);
+
+    // A downsampled section only covers its own section, so sections
+    // hidden at full resolution stay hidden
+    int section_layers = Section_Size >> lod;
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        mesh->sections[s] = uint32_t(mesh->vertices.size());
+        if (section_hidden(padded, s)) continue;
+
+        GreedyBox box;
+        box.data = &lod_voxels.voxels[1][s * section_layers][1];
+        box.strides[0] = (Chunk_SizeY / 2) * (Chunk_SizeZ / 2 + 2);
+        box.strides[1] = Chunk_SizeZ / 2 + 2;
+        box.strides[2] = 1;
+        box.size = section_layers;
+        box.base_y = s * section_layers;
+        box.height = Chunk_SizeY >> lod;
+        box.scale = 1 << lod;
+        greedy_box(box, mesh);
+    }
+    mesh->sections[Chunk_Sections] = uint32_t(mesh->vertices.size());
+}
+
+void build_mesh(const PaddedVoxels &padded, Mesher mesher, Mesh *mesh) {
+    mesh->vertices.clear();
+
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        mesh->sections[s] = uint32_t(mesh->vertices.size());
+        build_section_mesh(padded, s, mesher, mesh);
+    }
+    mesh->sections[Chunk_Sections] = uint32_t(mesh->vertices.size());
+}
@@ -0,0 +1,130 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include <vector>
+#include <cstdint>
+
+#include "xmath.h"
+#include "voxel.h"
+
+// Strategy used to turn a chunk's voxels into triangles. On the terrain
+// benchmark in mesher_test.cpp, Mesher_Greedy takes about 1.5 times as
+// long as Mesher_Naive and Mesher_Binary about 0.6 times.
+enum Mesher {
+    // One quad per exposed voxel face.
+    Mesher_Naive,
+    // Merges coplanar faces of the same voxel type into the largest
+    // rectangles that fit in each slice of the chunk. Reads every voxel
+    // once per direction to find the visible faces.
+    Mesher_Greedy,
+    // Same output as Mesher_Greedy, finding the visible faces of whole
+    // rows of voxels at once with bit masks. The fastest of the three.
+    Mesher_Binary,
+};
+
+// Direction a face is pointing towards, laid out as 2 * axis + negative.
+enum Face : uint8_t {
+    Face_PosX,
+    Face_NegX,
+    Face_PosY,
+    Face_NegY,
+    Face_PosZ,
+    Face_NegZ,
+};
+
+// A vertex packed into 32 bits:
+//
+//   bits  0..4   x corner (0..16)
+//   bits  5..13  y corner (0..256)
+//   bits 14..18  z corner (0..16)
+//   bits 19..21  Face
+//   bits 22..29  Voxel, used as an index into the color palette
+//
+// Corners are in voxel corner space, the voxel at (x, y, z) spans the
+// corners (x, y, z) to (x + 1, y + 1, z + 1). The vertex shader decodes
+// the position and shifts it back by half a voxel so voxel centers lie
+// on integer coordinates.
+using PackedVertex = uint32_t;
+
+constexpr int Vertex_BitsX = 5;
+constexpr int Vertex_BitsY = 9;
+constexpr int Vertex_BitsZ = 5;
+constexpr int Vertex_BitsFace = 3;
+
+static_assert(Chunk_SizeX < (1 << Vertex_BitsX), "Chunk too large for packed vertex");
+static_assert(Chunk_SizeY < (1 << Vertex_BitsY), "Chunk too large for packed vertex");
+static_assert(Chunk_SizeZ < (1 << Vertex_BitsZ), "Chunk too large for packed vertex");
+
+constexpr int Vertex_ShiftY = Vertex_BitsX;
+constexpr int Vertex_ShiftZ = Vertex_ShiftY + Vertex_BitsY;
+constexpr int Vertex_ShiftFace = Vertex_ShiftZ + Vertex_BitsZ;
+constexpr int Vertex_ShiftVoxel = Vertex_ShiftFace + Vertex_BitsFace;
+
+inline PackedVertex pack_vertex(const Point3 &corner, Face face, Voxel voxel) {
+    return PackedVertex(corner.x)
+         | PackedVertex(corner.y) << Vertex_ShiftY
+         | PackedVertex(corner.z) << Vertex_ShiftZ
+         | PackedVertex(face) << Vertex_ShiftFace
+         | PackedVertex(voxel) << Vertex_ShiftVoxel;
+}
+
+// Meshes are made of quads, 4 vertices each. The renderer draws them
+// with a shared index buffer so no indices are stored per mesh.
+struct Mesh {
+    std::vector<PackedVertex> vertices;
+
+    // Vertices are grouped by section, section s being the vertices
+    // [sections[s], sections[s + 1]). Lets edits replace the vertices of
+    // a single section.
+    uint32_t sections[Chunk_Sections + 1] = {};
+
+    size_t quad_count() const { return vertices.size() / 4; }
+};
+
+// A chunk's voxels with a one voxel border on its four vertical sides
+// copied from the neighboring chunks, so faces between two chunks can be
+// culled. Indexed [x + 1][y][z + 1]. Borders of missing neighbors are air.
+struct PaddedVoxels {
+    Voxel voxels[Chunk_SizeX + 2][Chunk_SizeY][Chunk_SizeZ + 2];
+
+    // Kind of each section of the interior. Sections may be marked
+    // Section_Mixed even if they are uniform, but never the other way
+    // around.
+    SectionKind sections[Chunk_Sections];
+};
+
+// Number of levels of detail. Level n meshes a chunk with one voxel for
+// every 2^n chunk voxels on each axis, level 0 being full resolution.
+constexpr int Lod_Levels = 4;
+
+static_assert(Section_Size >> (Lod_Levels - 1) >= 1, "Sections too small for the last level");
+
+// Returns the voxel standing for a block of `total` chunk voxels at a
+// lower level of detail, given how many voxels of each type the block
+// holds. The block is solid if at least half of it is, and takes its
+// most common solid type, so the ground neither sinks nor swells.
+Voxel downsample_block(const int (&counts)[Voxel_Types], int total);
+
+// Builds the mesh for a chunk's voxels, replacing the contents of `mesh`.
+// Sections of air and solid sections enclosed on all sides are skipped.
+// Only touches the CPU side so it can run without an OpenGL context and
+// on any thread.
+void build_mesh(const PaddedVoxels &padded, Mesher mesher, Mesh *mesh);
+
+// Builds the mesh of a single section of a chunk and appends it to
+// `mesh`, leaving Mesh::sections alone. Only the layers of `padded`
+// listed by Chunk::pad_section need to be filled.
+void build_section_mesh(const PaddedVoxels &padded, int section, Mesher mesher, Mesh *mesh);
+
+// Builds the mesh for a chunk at level of detail `lod`, from 1 to
+// Lod_Levels - 1. The interior of `padded` is downsampled and meshed
+// greedily, with the quads scaled back to chunk corner space so the mesh
+// is drawn like any other.
+//
+// Each side of the border must hold a neighbor at the same level, as
+// written by Chunk::pad_border, or air. Leaving air towards neighbors at
+// other levels makes the chunk close its side of the seam, so no cracks
+// open where the two surfaces differ.
+void build_lod_mesh(const PaddedVoxels &padded, int lod, Mesh *mesh);
+
+#endif // MESHER_H
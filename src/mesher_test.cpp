@@ -0,0 +1,430 @@
+#include "mesher.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "xmath.h"
+#include "voxel.h"
+#include "random.h"
+
+static Point3 unpack_corner(PackedVertex v) {
+    return Point3(v & ((1 << Vertex_BitsX) - 1),
+                  (v >> Vertex_ShiftY) & ((1 << Vertex_BitsY) - 1),
+                  (v >> Vertex_ShiftZ) & ((1 << Vertex_BitsZ) - 1));
+}
+
+static Face unpack_face(PackedVertex v) {
+    return Face((v >> Vertex_ShiftFace) & ((1 << Vertex_BitsFace) - 1));
+}
+
+// Total area of the quads facing each direction
+static void face_area(const Mesh &mesh, int (&area)[6]) {
+    for (int i = 0; i < 6; ++i) area[i] = 0;
+
+    for (size_t q = 0; q < mesh.quad_count(); ++q) {
+        const auto *v = &mesh.vertices[q * 4];
+        auto e = math::cross(Vector3(unpack_corner(v[1]) - unpack_corner(v[0])),
+                             Vector3(unpack_corner(v[3]) - unpack_corner(v[0])));
+        auto face = unpack_face(v[0]);
+        int axis = face / 2;
+        // Winding must agree with the face direction
+        assert((face & 1) ? e[axis] < 0.0f : e[axis] > 0.0f);
+        area[face] += int(fabsf(e[axis]));
+    }
+}
+
+static void make_terrain(VoxelArray &voxels, const Point2 &offset) {
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            auto pos = Vector2(offset * Point2(Chunk_SizeX, Chunk_SizeZ) + Point2(x, z)) / 64.0f;
+            int height = int((snoise(pos) + 1) * 16);
+
+            for (int y = 0; y < height; ++y) {
+                voxels[x][y][z] = y < height / 2 ? Voxel_Stone : Voxel_Grass;
+            }
+        }
+    }
+}
+
+// Copies `voxels` into the interior of `padded`, clears the border and
+// classifies the sections, like Chunk::pad for a dense array
+static void pad_voxels(const VoxelArray &voxels, PaddedVoxels *padded) {
+    memset(padded->voxels[0], 0, sizeof(padded->voxels[0]));
+    memset(padded->voxels[Chunk_SizeX + 1], 0, sizeof(padded->voxels[0]));
+
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            auto *row = padded->voxels[x + 1][y];
+            row[0] = Voxel_Air;
+            memcpy(row + 1, voxels[x][y], Chunk_SizeZ);
+            row[Chunk_SizeZ + 1] = Voxel_Air;
+        }
+    }
+
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        int n_air = 0;
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = s * Section_Size; y < (s + 1) * Section_Size; ++y) {
+                for (int z = 0; z < Chunk_SizeZ; ++z) {
+                    n_air += voxels[x][y][z] == Voxel_Air;
+                }
+            }
+        }
+
+        constexpr int N = Section_Size * Section_Size * Section_Size;
+        padded->sections[s] = n_air == N ? Section_Air : n_air == 0 ? Section_Solid : Section_Mixed;
+    }
+}
+
+// Copies the layer of `neighbor` touching the chunk into the border of
+// `padded`, like Chunk::pad_border for a dense array
+static void pad_border(const VoxelArray &neighbor, Face side, PaddedVoxels *padded) {
+    switch (side) {
+    case Face_PosX:
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            memcpy(&padded->voxels[Chunk_SizeX + 1][y][1], neighbor[0][y], Chunk_SizeZ);
+        }
+        break;
+    case Face_NegX:
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            memcpy(&padded->voxels[0][y][1], neighbor[Chunk_SizeX - 1][y], Chunk_SizeZ);
+        }
+        break;
+    case Face_PosZ:
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = 0; y < Chunk_SizeY; ++y) {
+                padded->voxels[x + 1][y][Chunk_SizeZ + 1] = neighbor[x][y][0];
+            }
+        }
+        break;
+    case Face_NegZ:
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int y = 0; y < Chunk_SizeY; ++y) {
+                padded->voxels[x + 1][y][0] = neighbor[x][y][Chunk_SizeZ - 1];
+            }
+        }
+        break;
+    default:
+        assert(false && "pad_border: Chunks have no vertical neighbors");
+    }
+}
+
+static PaddedVoxels padded;
+
+void test_single_voxel() {
+    static VoxelArray voxels{};
+    voxels[3][7][5] = Voxel_Stone;
+    pad_voxels(voxels, &padded);
+
+    Mesh naive, greedy;
+    build_mesh(padded, Mesher_Naive, &naive);
+    build_mesh(padded, Mesher_Greedy, &greedy);
+
+    assert(naive.quad_count() == 6);
+    assert(greedy.quad_count() == 6);
+}
+
+void test_greedy_slab() {
+    static VoxelArray voxels{};
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            voxels[x][0][z] = Voxel_Grass;
+        }
+    }
+    pad_voxels(voxels, &padded);
+
+    Mesh naive, greedy;
+    build_mesh(padded, Mesher_Naive, &naive);
+    build_mesh(padded, Mesher_Greedy, &greedy);
+
+    assert(naive.quad_count() == 2 * Chunk_SizeX * Chunk_SizeZ + 2 * Chunk_SizeX + 2 * Chunk_SizeZ);
+    assert(greedy.quad_count() == 6);
+
+    // Surrounded by the same slab on all sides only the top and bottom
+    // remain.
+    pad_border(voxels, Face_PosX, &padded);
+    pad_border(voxels, Face_NegX, &padded);
+    pad_border(voxels, Face_PosZ, &padded);
+    pad_border(voxels, Face_NegZ, &padded);
+
+    build_mesh(padded, Mesher_Naive, &naive);
+    build_mesh(padded, Mesher_Greedy, &greedy);
+
+    assert(naive.quad_count() == 2 * Chunk_SizeX * Chunk_SizeZ);
+    assert(greedy.quad_count() == 2);
+}
+
+void test_border_side() {
+    // A single column at x = 0 is only hidden by a neighbor on -X
+    static VoxelArray voxels{};
+    static VoxelArray neighbor{};
+    voxels[0][0][4] = Voxel_Stone;
+    neighbor[Chunk_SizeX - 1][0][4] = Voxel_Stone;
+
+    pad_voxels(voxels, &padded);
+    pad_border(neighbor, Face_PosX, &padded);
+    pad_border(neighbor, Face_PosZ, &padded);
+
+    Mesh mesh;
+    build_mesh(padded, Mesher_Naive, &mesh);
+    assert(mesh.quad_count() == 6);
+
+    pad_border(neighbor, Face_NegX, &padded);
+    build_mesh(padded, Mesher_Naive, &mesh);
+    assert(mesh.quad_count() == 5);
+
+    build_mesh(padded, Mesher_Greedy, &mesh);
+    assert(mesh.quad_count() == 5);
+}
+
+void test_mesher_area() {
+    static VoxelArray voxels;
+
+    for (int i = 0; i < 8; ++i) {
+        memset(voxels, 0, sizeof(voxels));
+        make_terrain(voxels, Point2(i, -i));
+        pad_voxels(voxels, &padded);
+
+        Mesh naive, greedy;
+        build_mesh(padded, Mesher_Naive, &naive);
+        build_mesh(padded, Mesher_Greedy, &greedy);
+
+        int naive_area[6], greedy_area[6];
+        face_area(naive, naive_area);
+        face_area(greedy, greedy_area);
+
+        for (int f = 0; f < 6; ++f) {
+            assert(naive_area[f] == greedy_area[f]);
+        }
+        assert(greedy.quad_count() < naive.quad_count());
+    }
+}
+
+void test_binary_mesher() {
+    static VoxelArray voxels;
+    Xorshift64 rng{11};
+
+    // Terrain, then random voxels of mixed types with random borders so
+    // runs are split by type and faces between chunks are culled
+    for (int i = 0; i < 16; ++i) {
+        memset(voxels, 0, sizeof(voxels));
+        if (i < 8) {
+            make_terrain(voxels, Point2(i, 2 * i));
+        } else {
+            for (int x = 0; x < Chunk_SizeX; ++x) {
+                for (int y = 0; y < 96; ++y) {
+                    for (int z = 0; z < Chunk_SizeZ; ++z) {
+                        if (rng.nextf(0.0f, 1.0f) < 0.4f) voxels[x][y][z] = Voxel(1 + (x / 5 + y / 7 + z / 6) % 3);
+                    }
+                }
+            }
+        }
+        pad_voxels(voxels, &padded);
+        if (i >= 8) {
+            for (int y = 0; y < 96; ++y) {
+                for (int k = 1; k <= Chunk_SizeZ; ++k) {
+                    padded.voxels[0][y][k] = Voxel(rng.nextf(0.0f, 1.0f) < 0.5f);
+                    padded.voxels[k][y][Chunk_SizeZ + 1] = Voxel(rng.nextf(0.0f, 1.0f) < 0.5f);
+                }
+            }
+        }
+
+        Mesh greedy, binary;
+        build_mesh(padded, Mesher_Greedy, &greedy);
+        build_mesh(padded, Mesher_Binary, &binary);
+
+        assert(binary.vertices == greedy.vertices);
+        for (int s = 0; s <= Chunk_Sections; ++s) {
+            assert(binary.sections[s] == greedy.sections[s]);
+        }
+    }
+
+    // Solid to the top of the chunk, the top faces are visible
+    memset(voxels, Voxel_Stone, sizeof(voxels));
+    pad_voxels(voxels, &padded);
+    Mesh mesh;
+    build_mesh(padded, Mesher_Binary, &mesh);
+    int area[6];
+    face_area(mesh, area);
+    assert(area[Face_PosY] == Chunk_SizeX * Chunk_SizeZ && area[Face_NegY] == Chunk_SizeX * Chunk_SizeZ);
+}
+
+void test_section_mesh() {
+    static VoxelArray voxels;
+    memset(voxels, 0, sizeof(voxels));
+    make_terrain(voxels, Point2(3, 1));
+    voxels[5][16][5] = Voxel_Wood;
+    voxels[5][47][5] = Voxel_Wood;
+    pad_voxels(voxels, &padded);
+
+    // Sections built one at a time are the slices of the full mesh
+    for (auto mesher : {Mesher_Naive, Mesher_Greedy, Mesher_Binary}) {
+        Mesh full;
+        build_mesh(padded, mesher, &full);
+        assert(full.sections[0] == 0 && full.sections[Chunk_Sections] == full.vertices.size());
+
+        Mesh section;
+        for (int s = 0; s < Chunk_Sections; ++s) {
+            section.vertices.clear();
+            build_section_mesh(padded, s, mesher, &section);
+
+            assert(section.vertices.size() == full.sections[s + 1] - full.sections[s]);
+            assert(std::equal(section.vertices.begin(), section.vertices.end(),
+                              full.vertices.begin() + full.sections[s]));
+        }
+    }
+}
+
+void test_downsample_block() {
+    int counts[Voxel_Types] = {};
+    counts[Voxel_Air] = 5;
+    counts[Voxel_Stone] = 3;
+    assert(downsample_block(counts, 8) == Voxel_Air);
+
+    // Half solid is solid, with the most common type
+    counts[Voxel_Air] = 4;
+    counts[Voxel_Stone] = 1;
+    counts[Voxel_Grass] = 3;
+    assert(downsample_block(counts, 8) == Voxel_Grass);
+}
+
+void test_lod_mesh() {
+    // An aligned 8x8x8 cube looks the same at every level
+    static VoxelArray voxels{};
+    for (int x = 0; x < 8; ++x) {
+        for (int y = 16; y < 24; ++y) {
+            for (int z = 8; z < 16; ++z) {
+                voxels[x][y][z] = Voxel_Stone;
+            }
+        }
+    }
+    // A single voxel is lost past level 0
+    voxels[12][40][3] = Voxel_Grass;
+    pad_voxels(voxels, &padded);
+
+    Mesh full;
+    build_mesh(padded, Mesher_Greedy, &full);
+    int full_area[6];
+    face_area(full, full_area);
+    assert(full.quad_count() == 12);
+
+    for (int lod = 1; lod < Lod_Levels; ++lod) {
+        Mesh mesh;
+        build_lod_mesh(padded, lod, &mesh);
+        assert(mesh.quad_count() == 6);
+
+        int area[6];
+        face_area(mesh, area);
+        for (int f = 0; f < 6; ++f) {
+            assert(area[f] == full_area[f] - 1);
+        }
+    }
+
+    // Terrain loses detail, and quads, with every level
+    for (int i = 0; i < 8; ++i) {
+        memset(voxels, 0, sizeof(voxels));
+        make_terrain(voxels, Point2(i, -i));
+        pad_voxels(voxels, &padded);
+
+        Mesh mesh;
+        build_mesh(padded, Mesher_Greedy, &mesh);
+        size_t quads = mesh.quad_count();
+        for (int lod = 1; lod < Lod_Levels; ++lod) {
+            build_lod_mesh(padded, lod, &mesh);
+            // Checks the winding of the scaled quads
+            int area[6];
+            face_area(mesh, area);
+            assert(mesh.quad_count() < quads);
+            quads = mesh.quad_count();
+        }
+    }
+}
+
+void test_lod_seam() {
+    // A slab against a border of the same slab only shows its top and
+    // bottom. Against air it also closes its side.
+    static VoxelArray voxels{};
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                voxels[x][y][z] = Voxel_Stone;
+            }
+        }
+    }
+    pad_voxels(voxels, &padded);
+    for (int y = 0; y < 4; ++y) {
+        for (int i = 1; i <= Section_Size; ++i) {
+            padded.voxels[0][y][i] = Voxel_Stone;
+            padded.voxels[Chunk_SizeX + 1][y][i] = Voxel_Stone;
+            padded.voxels[i][y][0] = Voxel_Stone;
+        }
+    }
+
+    Mesh mesh;
+    build_lod_mesh(padded, 1, &mesh);
+    int area[6];
+    face_area(mesh, area);
+    assert(area[Face_PosY] == Chunk_SizeX * Chunk_SizeZ);
+    assert(area[Face_PosX] == 0 && area[Face_NegX] == 0 && area[Face_NegZ] == 0);
+    assert(area[Face_PosZ] == Chunk_SizeX * 4);
+}
+
+void bench_mesher(Mesher mesher, const char *name) {
+    constexpr int N = 64;
+    static VoxelArray voxels;
+    memset(voxels, 0, sizeof(voxels));
+    make_terrain(voxels, Point2(0, 0));
+    pad_voxels(voxels, &padded);
+
+    Mesh mesh;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i) {
+        build_mesh(padded, mesher, &mesh);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / N;
+
+    printf("[BENCH] %-8s %8.1f us/chunk %6zu quads\n", name, us, mesh.quad_count());
+}
+
+void bench_lod_mesh(int lod) {
+    constexpr int N = 64;
+    static VoxelArray voxels;
+    memset(voxels, 0, sizeof(voxels));
+    make_terrain(voxels, Point2(0, 0));
+    pad_voxels(voxels, &padded);
+
+    Mesh mesh;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i) {
+        build_lod_mesh(padded, lod, &mesh);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / N;
+
+    printf("[BENCH] lod %-4d %8.1f us/chunk %6zu quads\n", lod, us, mesh.quad_count());
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_single_voxel();
+    test_greedy_slab();
+    test_border_side();
+    test_mesher_area();
+    test_binary_mesher();
+    test_section_mesh();
+    test_downsample_block();
+    test_lod_mesh();
+    test_lod_seam();
+
+    bench_mesher(Mesher_Naive, "naive");
+    bench_mesher(Mesher_Greedy, "greedy");
+    bench_mesher(Mesher_Binary, "binary");
+    for (int lod = 1; lod < Lod_Levels; ++lod) bench_lod_mesh(lod);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+#include <mutex>
+#include <utility>
+
+// Free list of heap objects of type T, for objects that are created and
+// destroyed all the time such as chunks streaming in and out. Released
+// objects are kept as they are, along with any memory they own such as
+// vector capacity, so reusing them does not allocate. Callers reset the
+// objects they acquire. Objects are only destroyed with the pool. Safe to
+// use from several threads.
+template <typename T>
+class Pool {
+public:
+    Pool() = default;
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    ~Pool() {
+        for (auto *object : free_list) delete object;
+    }
+
+    // Returns a released object, or a new one constructed from `args` if
+    // there is none
+    template <typename... Args>
+    T *acquire(Args &&...args) {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (!free_list.empty()) {
+                auto *object = free_list.back();
+                free_list.pop_back();
+                return object;
+            }
+        }
+        return new T{std::forward<Args>(args)...};
+    }
+
+    void release(T *object) {
+        std::lock_guard<std::mutex> lock{mutex};
+        free_list.push_back(object);
+    }
+
+    size_t free_count() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return free_list.size();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<T *> free_list;
+};
+
+#endif // POOL_H
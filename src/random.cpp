@@ -2,9 +2,11 @@
 
 #include <cmath>
 #include <cstring>
+#include <vector>
 #include <algorithm>
 
 #include "xmath.h"
+#include "math_simd.h"
 
 static const Vector3 grad3[] = {
     {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
@@ -23,7 +25,8 @@ static const Vector4 grad4[] = {
     {-1,  1, 1, 0}, {-1,  1, -1,  0}, {-1, -1,  1, 0}, {-1, -1, -1,  0},
 };
 
-static unsigned char perm[512] = {
+// Permutation table of the reference implementation by Ken Perlin
+static const uint8_t reference_perm[512] = {
     151,160,137, 91, 90, 15,131, 13,201, 95, 96, 53,194,233,  7,225,
     140, 36,103, 30, 69,142,  8, 99, 37,240, 21, 10, 23,190,  6,148,
     247,120,234, 75,  0, 26,197, 62, 94,252,219,203,117, 35, 11, 32,
@@ -73,11 +76,18 @@ static inline float gradient(const U *grad, int gi, const T &v, float c) {
     return t * t * math::dot(T(grad[gi]), v);
 }
 
-void snoise_seed(uint64_t seed) {
-    Xorshift64 rng{seed};
+NoiseGenerator::NoiseGenerator() : seed{0} {
+    memcpy(perm, reference_perm, sizeof(perm));
+}
+
+NoiseGenerator::NoiseGenerator(uint64_t seed) : seed{seed} {
+    memcpy(perm, reference_perm, sizeof(perm));
+
+    // SplitMix rather than Xorshift, which has no valid state for seed 0
+    SplitMix64 rng{seed};
     int len = sizeof(perm) / 2;
     for (int i = len - 1; i > 0; --i) {
-        int target = int(rng.nextf(0.0f, float(i) + 1.0f));
+        int target = int(rng.nexti64() % uint64_t(i + 1));
         std::swap(perm[i], perm[target]);
     }
     // Duplicate for the other 256 elements
@@ -85,7 +95,7 @@ void snoise_seed(uint64_t seed) {
 }
 
 // Based on the 2D simplex noise code by Stefan Gustavson.
-float snoise(const Vector2 &v) {
+float NoiseGenerator::snoise(const Vector2 &v) const {
     constexpr float F2 = 0.366025403784439f;  // 0.5*(sqrt(3.0)-1.0) (skew)
     constexpr float G2 = 0.211324865405187f;  // (3.0-sqrt(3.0))/6.0 (unskew)
 
@@ -125,7 +135,7 @@ float snoise(const Vector2 &v) {
 }
 
 // Based on the 3D simplex noise code by Stefan Gustavson.
-float snoise(const Vector3 &v) {
+float NoiseGenerator::snoise(const Vector3 &v) const {
     constexpr float F3 = 1.0f / 3.0f; // (skew)
     constexpr float G3 = 1.0f / 6.0f; // (unskew)
 
@@ -188,7 +198,7 @@ float snoise(const Vector3 &v) {
 
 // Based on the improved simplex rank ordering method for 4D simplex noise
 // by Stefan Gustavson.
-float snoise(const Vector4 &v) {
+float NoiseGenerator::snoise(const Vector4 &v) const {
     constexpr float F4 = 0.309016994375947f; // (sqrt(5.0)-1)/4.0 (skew)
     constexpr float G4 = 0.138196601125011f; // (5.0-sqrt(5.0))/20.0 (unskew)
 
@@ -255,14 +265,376 @@ float snoise(const Vector4 &v) {
     return 27.0f * (n0 + n1 + n2 + n3 + n4);
 }
 
+#ifdef MATH_ARCH_SSE2
+
+// The SIMD kernels below repeat the scalar noise functions operation for
+// operation so they round the same way. Permutation and gradient lookups
+// have no SSE2 equivalent and are done per lane.
+
+static inline int perm_gradient(const uint8_t *perm, int i, int j) {
+    return perm[(i & 255) + perm[j & 255]] % 12;
+}
+
+static inline int perm_gradient(const uint8_t *perm, int i, int j, int k) {
+    return perm[(i & 255) + perm[(j & 255) + perm[k & 255]]] % 12;
+}
+
+static inline __m128i floortoi(__m128 v) {
+    __m128i i = _mm_cvttps_epi32(v);
+    // Truncation rounds negative values up, the comparison mask is -1
+    // in the lanes that need to be corrected.
+    return _mm_add_epi32(i, _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(i))));
+}
+
+static inline __m128 gradient(__m128 gx, __m128 gy, __m128 x, __m128 y, float c) {
+    __m128 t = _mm_sub_ps(_mm_set1_ps(c), _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+    __m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    __m128 dot = _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y));
+    return _mm_and_ps(inside, _mm_mul_ps(_mm_mul_ps(t, t), dot));
+}
+
+static inline __m128 gradient(__m128 gx, __m128 gy, __m128 gz,
+                              __m128 x, __m128 y, __m128 z, float c) {
+    __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    __m128 t = _mm_sub_ps(_mm_set1_ps(c), len2);
+    __m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y)), _mm_mul_ps(gz, z));
+    return _mm_and_ps(inside, _mm_mul_ps(_mm_mul_ps(t, t), dot));
+}
+
+// Loads the gradient components for the 4 lanes
+static inline void load_grad3(const int (&gi)[4], __m128 *gx, __m128 *gy, __m128 *gz) {
+    *gx = _mm_setr_ps(grad3[gi[0]].x, grad3[gi[1]].x, grad3[gi[2]].x, grad3[gi[3]].x);
+    *gy = _mm_setr_ps(grad3[gi[0]].y, grad3[gi[1]].y, grad3[gi[2]].y, grad3[gi[3]].y);
+    *gz = _mm_setr_ps(grad3[gi[0]].z, grad3[gi[1]].z, grad3[gi[2]].z, grad3[gi[3]].z);
+}
+
+// `grad` returns the gradient index of the lattice corner (i, j)
+template <typename Grad>
+static void snoise4(const float *px, const float *py, float *out, Grad grad) {
+    constexpr float F2 = 0.366025403784439f;
+    constexpr float G2 = 0.211324865405187f;
+
+    __m128 x = _mm_loadu_ps(px);
+    __m128 y = _mm_loadu_ps(py);
+
+    // Skew to find the simplex cell
+    __m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(F2));
+    __m128i i = floortoi(_mm_add_ps(x, s));
+    __m128i j = floortoi(_mm_add_ps(y, s));
+    __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), _mm_set1_ps(G2));
+
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+    // Which triangle of the cell we are in, 1 or 0
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 i1 = _mm_and_ps(_mm_cmpgt_ps(x0, y0), one);
+    __m128 j1 = _mm_sub_ps(one, i1);
+
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), _mm_set1_ps(G2));
+    __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), _mm_set1_ps(G2));
+    __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(2.0f * G2));
+    __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(2.0f * G2));
+
+    alignas(16) int ii[4], jj[4], ii1[4];
+    _mm_store_si128((__m128i *)ii, i);
+    _mm_store_si128((__m128i *)jj, j);
+    _mm_store_si128((__m128i *)ii1, _mm_cvttps_epi32(i1));
+
+    int gi0[4], gi1[4], gi2[4];
+    for (int k = 0; k < 4; ++k) {
+        gi0[k] = grad(ii[k], jj[k]);
+        gi1[k] = grad(ii[k] + ii1[k], jj[k] + 1 - ii1[k]);
+        gi2[k] = grad(ii[k] + 1, jj[k] + 1);
+    }
+
+    __m128 gx, gy, gz;
+    load_grad3(gi0, &gx, &gy, &gz);
+    __m128 n0 = gradient(gx, gy, x0, y0, 0.5f);
+    load_grad3(gi1, &gx, &gy, &gz);
+    __m128 n1 = gradient(gx, gy, x1, y1, 0.5f);
+    load_grad3(gi2, &gx, &gy, &gz);
+    __m128 n2 = gradient(gx, gy, x2, y2, 0.5f);
+
+    __m128 n = _mm_add_ps(_mm_add_ps(n0, n1), n2);
+    _mm_storeu_ps(out, _mm_mul_ps(_mm_set1_ps(70.0f), n));
+}
+
+// `grad` returns the gradient index of the lattice corner (i, j, k)
+template <typename Grad>
+static void snoise4(const float *px, const float *py, const float *pz, float *out, Grad grad) {
+    constexpr float F3 = 1.0f / 3.0f;
+    constexpr float G3 = 1.0f / 6.0f;
+
+    __m128 x = _mm_loadu_ps(px);
+    __m128 y = _mm_loadu_ps(py);
+    __m128 z = _mm_loadu_ps(pz);
+
+    // Skew to find the simplex cell
+    __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z), _mm_set1_ps(F3));
+    __m128i i = floortoi(_mm_add_ps(x, s));
+    __m128i j = floortoi(_mm_add_ps(y, s));
+    __m128i k = floortoi(_mm_add_ps(z, s));
+    __m128i ijk = _mm_add_epi32(_mm_add_epi32(i, j), k);
+    __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(ijk), _mm_set1_ps(G3));
+
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+    __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+    __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+
+    // Branchless form of the simplex selection in snoise(Vector3)
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 a = _mm_cmpge_ps(x0, y0);
+    __m128 b = _mm_cmpge_ps(y0, z0);
+    __m128 c = _mm_cmpge_ps(x0, z0);
+    __m128 nb = _mm_andnot_ps(b, one);
+    __m128 nc = _mm_andnot_ps(c, one);
+
+    __m128 i1 = _mm_and_ps(_mm_and_ps(a, _mm_or_ps(b, c)), one);
+    __m128 j1 = _mm_and_ps(_mm_andnot_ps(a, b), one);
+    __m128 k1 = _mm_and_ps(nb, _mm_or_ps(_mm_andnot_ps(a, one), nc));
+    __m128 i2 = _mm_and_ps(_mm_or_ps(a, _mm_and_ps(b, c)), one);
+    __m128 j2 = _mm_and_ps(_mm_or_ps(_mm_andnot_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))), b), one);
+    __m128 k2 = _mm_or_ps(nb, nc);
+
+    __m128 g1 = _mm_set1_ps(G3);
+    __m128 g2 = _mm_set1_ps(2.0f * G3);
+    __m128 g3 = _mm_set1_ps(3.0f * G3);
+
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g1);
+    __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g1);
+    __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, k1), g1);
+    __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, i2), g2);
+    __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, j2), g2);
+    __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, k2), g2);
+    __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, one), g3);
+    __m128 y3 = _mm_add_ps(_mm_sub_ps(y0, one), g3);
+    __m128 z3 = _mm_add_ps(_mm_sub_ps(z0, one), g3);
+
+    alignas(16) int ii[4], jj[4], kk[4];
+    alignas(16) int o1[3][4], o2[3][4];
+    _mm_store_si128((__m128i *)ii, i);
+    _mm_store_si128((__m128i *)jj, j);
+    _mm_store_si128((__m128i *)kk, k);
+    _mm_store_si128((__m128i *)o1[0], _mm_cvttps_epi32(i1));
+    _mm_store_si128((__m128i *)o1[1], _mm_cvttps_epi32(j1));
+    _mm_store_si128((__m128i *)o1[2], _mm_cvttps_epi32(k1));
+    _mm_store_si128((__m128i *)o2[0], _mm_cvttps_epi32(i2));
+    _mm_store_si128((__m128i *)o2[1], _mm_cvttps_epi32(j2));
+    _mm_store_si128((__m128i *)o2[2], _mm_cvttps_epi32(k2));
+
+    int gi0[4], gi1[4], gi2[4], gi3[4];
+    for (int l = 0; l < 4; ++l) {
+        gi0[l] = grad(ii[l], jj[l], kk[l]);
+        gi1[l] = grad(ii[l] + o1[0][l], jj[l] + o1[1][l], kk[l] + o1[2][l]);
+        gi2[l] = grad(ii[l] + o2[0][l], jj[l] + o2[1][l], kk[l] + o2[2][l]);
+        gi3[l] = grad(ii[l] + 1, jj[l] + 1, kk[l] + 1);
+    }
+
+    __m128 gx, gy, gz;
+    load_grad3(gi0, &gx, &gy, &gz);
+    __m128 n0 = gradient(gx, gy, gz, x0, y0, z0, 0.6f);
+    load_grad3(gi1, &gx, &gy, &gz);
+    __m128 n1 = gradient(gx, gy, gz, x1, y1, z1, 0.6f);
+    load_grad3(gi2, &gx, &gy, &gz);
+    __m128 n2 = gradient(gx, gy, gz, x2, y2, z2, 0.6f);
+    load_grad3(gi3, &gx, &gy, &gz);
+    __m128 n3 = gradient(gx, gy, gz, x3, y3, z3, 0.6f);
+
+    __m128 n = _mm_add_ps(_mm_add_ps(_mm_add_ps(n0, n1), n2), n3);
+    _mm_storeu_ps(out, _mm_mul_ps(_mm_set1_ps(32.0f), n));
+}
+
+#endif
+
+void NoiseGenerator::snoise_batch(const float *x, const float *y, float *out, int count) const {
+    int i = 0;
+#ifdef MATH_ARCH_SSE2
+    for (; i + 4 <= count; i += 4) {
+        snoise4(x + i, y + i, out + i,
+                [this](int ci, int cj) { return perm_gradient(perm, ci, cj); });
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = snoise(Vector2(x[i], y[i]));
+    }
+}
+
+void NoiseGenerator::snoise_batch(const float *x, const float *y, const float *z,
+                                  float *out, int count) const {
+    int i = 0;
+#ifdef MATH_ARCH_SSE2
+    for (; i + 4 <= count; i += 4) {
+        snoise4(x + i, y + i, z + i, out + i,
+                [this](int ci, int cj, int ck) { return perm_gradient(perm, ci, cj, ck); });
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = snoise(Vector3(x[i], y[i], z[i]));
+    }
+}
+
+#ifdef MATH_ARCH_SSE2
+
+// Lattice corners the grid functions need gradients for along one axis.
+// Skewing is monotonic so the first and last samples bound the range.
+// One extra corner is added on each side in case the skew of a sample
+// rounds across a cell boundary.
+static void corner_range(float first, float last, int *min, int *count) {
+    int a = floortoi(std::min(first, last));
+    int b = floortoi(std::max(first, last));
+    *min = a - 1;
+    *count = b - a + 4;
+}
+
+// Past this many corners the grid functions hash corners per sample
+constexpr int Max_Grid_Corners = 1 << 16;
+
+#endif
+
+void NoiseGenerator::snoise_grid(const Vector2 &origin, float frequency,
+                                 int nx, int ny, float *out) const {
+    if (nx <= 0 || ny <= 0) return;
+
+    // Scratch is kept per thread so generating chunks does not allocate
+    static thread_local std::vector<float> ys, xs;
+    ys.resize(size_t(ny));
+    for (int j = 0; j < ny; ++j) {
+        ys[j] = (origin.y + float(j)) * frequency;
+    }
+
+#ifdef MATH_ARCH_SSE2
+    constexpr float F2 = 0.366025403784439f;
+
+    Vector2 lo = origin * frequency;
+    Vector2 hi = (origin + Vector2(float(nx - 1), float(ny - 1))) * frequency;
+    float s_lo = (lo.x + lo.y) * F2;
+    float s_hi = (hi.x + hi.y) * F2;
+
+    int min_i, min_j, size_i, size_j;
+    corner_range(lo.x + s_lo, hi.x + s_hi, &min_i, &size_i);
+    corner_range(lo.y + s_lo, hi.y + s_hi, &min_j, &size_j);
+
+    if (int64_t(size_i) * size_j <= Max_Grid_Corners) {
+        static thread_local std::vector<uint8_t> grads;
+        grads.resize(size_t(size_i * size_j));
+        for (int i = 0; i < size_i; ++i) {
+            for (int j = 0; j < size_j; ++j) {
+                grads[i * size_j + j] = uint8_t(perm_gradient(perm, min_i + i, min_j + j));
+            }
+        }
+        auto grad = [&](int ci, int cj) {
+            return int(grads[(ci - min_i) * size_j + (cj - min_j)]);
+        };
+
+        alignas(16) float x4[4];
+        for (int i = 0; i < nx; ++i) {
+            float x = (origin.x + float(i)) * frequency;
+            x4[0] = x4[1] = x4[2] = x4[3] = x;
+
+            float *row = out + i * ny;
+            int j = 0;
+            for (; j + 4 <= ny; j += 4) {
+                snoise4(x4, &ys[j], row + j, grad);
+            }
+            for (; j < ny; ++j) {
+                row[j] = snoise(Vector2(x, ys[j]));
+            }
+        }
+        return;
+    }
+#endif
+
+    xs.resize(size_t(ny));
+    for (int i = 0; i < nx; ++i) {
+        std::fill(xs.begin(), xs.end(), (origin.x + float(i)) * frequency);
+        snoise_batch(xs.data(), ys.data(), out + i * ny, ny);
+    }
+}
+
+void NoiseGenerator::snoise_grid(const Vector3 &origin, float frequency,
+                                 int nx, int ny, int nz, float *out) const {
+    if (nx <= 0 || ny <= 0 || nz <= 0) return;
+
+    static thread_local std::vector<float> zs, xs, ys;
+    zs.resize(size_t(nz));
+    for (int k = 0; k < nz; ++k) {
+        zs[k] = (origin.z + float(k)) * frequency;
+    }
+
+#ifdef MATH_ARCH_SSE2
+    constexpr float F3 = 1.0f / 3.0f;
+
+    Vector3 lo = origin * frequency;
+    Vector3 hi = (origin + Vector3(float(nx - 1), float(ny - 1), float(nz - 1))) * frequency;
+    float s_lo = (lo.x + lo.y + lo.z) * F3;
+    float s_hi = (hi.x + hi.y + hi.z) * F3;
+
+    int min_i, min_j, min_k, size_i, size_j, size_k;
+    corner_range(lo.x + s_lo, hi.x + s_hi, &min_i, &size_i);
+    corner_range(lo.y + s_lo, hi.y + s_hi, &min_j, &size_j);
+    corner_range(lo.z + s_lo, hi.z + s_hi, &min_k, &size_k);
+
+    if (int64_t(size_i) * size_j * size_k <= Max_Grid_Corners) {
+        static thread_local std::vector<uint8_t> grads;
+        grads.resize(size_t(size_i * size_j * size_k));
+        for (int i = 0; i < size_i; ++i) {
+            for (int j = 0; j < size_j; ++j) {
+                for (int k = 0; k < size_k; ++k) {
+                    grads[(i * size_j + j) * size_k + k] =
+                        uint8_t(perm_gradient(perm, min_i + i, min_j + j, min_k + k));
+                }
+            }
+        }
+        auto grad = [&](int ci, int cj, int ck) {
+            return int(grads[((ci - min_i) * size_j + (cj - min_j)) * size_k + (ck - min_k)]);
+        };
+
+        alignas(16) float x4[4], y4[4];
+        for (int i = 0; i < nx; ++i) {
+            float x = (origin.x + float(i)) * frequency;
+            x4[0] = x4[1] = x4[2] = x4[3] = x;
+
+            for (int j = 0; j < ny; ++j) {
+                float y = (origin.y + float(j)) * frequency;
+                y4[0] = y4[1] = y4[2] = y4[3] = y;
+
+                float *row = out + (i * ny + j) * nz;
+                int k = 0;
+                for (; k + 4 <= nz; k += 4) {
+                    snoise4(x4, y4, &zs[k], row + k, grad);
+                }
+                for (; k < nz; ++k) {
+                    row[k] = snoise(Vector3(x, y, zs[k]));
+                }
+            }
+        }
+        return;
+    }
+#endif
+
+    xs.resize(size_t(nz));
+    ys.resize(size_t(nz));
+    for (int i = 0; i < nx; ++i) {
+        std::fill(xs.begin(), xs.end(), (origin.x + float(i)) * frequency);
+        for (int j = 0; j < ny; ++j) {
+            std::fill(ys.begin(), ys.end(), (origin.y + float(j)) * frequency);
+            snoise_batch(xs.data(), ys.data(), zs.data(), out + (i * ny + j) * nz, nz);
+        }
+    }
+}
+
 template <typename T>
-static inline float fractal_fbm(T v, int octaves, float lac, float gain) {
+static inline float fractal_fbm(const NoiseGenerator &noise, T v, int octaves, float lac, float gain) {
     float sum = 0.0f;
     float amp = 1.0f;
     float frac_range = 0.0f;
 
     for (int i = 0; i < octaves; ++i) {
-        sum += snoise(v) * amp;
+        sum += noise.snoise(v) * amp;
         frac_range += amp;
         amp *= gain;
         v *= lac;
@@ -271,13 +643,13 @@ static inline float fractal_fbm(T v, int octaves, float lac, float gain) {
 }
 
 template <typename T>
-static inline float fractal_b(T v, int octaves, float lac, float gain) {
+static inline float fractal_b(const NoiseGenerator &noise, T v, int octaves, float lac, float gain) {
     float sum = 0.0f;
     float amp = 1.0f;
     float frac_range = 0.0f;
 
     for (int i = 0; i < octaves; ++i) {
-        sum += (fabsf(snoise(v)) * 2.0f - 1.0f) * amp;
+        sum += (fabsf(noise.snoise(v)) * 2.0f - 1.0f) * amp;
         frac_range += amp;
         amp *= gain;
         v *= lac;
@@ -285,18 +657,57 @@ static inline float fractal_b(T v, int octaves, float lac, float gain) {
     return sum / frac_range;
 }
 
+float NoiseGenerator::snoise_fractal(Vector3 v, int octaves, float lacunarity, float gain) const {
+    return fractal_fbm(*this, v, octaves, lacunarity, gain);
+}
+
+float NoiseGenerator::snoise_fractal(Vector2 v, int octaves, float lacunarity, float gain) const {
+    return fractal_fbm(*this, v, octaves, lacunarity, gain);
+}
+
+float NoiseGenerator::snoise_fractal_b(Vector3 v, int octaves, float lacunarity, float gain) const {
+    return fractal_b(*this, v, octaves, lacunarity, gain);
+}
+
+float NoiseGenerator::snoise_fractal_b(Vector2 v, int octaves, float lacunarity, float gain) const {
+    return fractal_b(*this, v, octaves, lacunarity, gain);
+}
+
+// The free functions share one generator, it is never modified
+static const NoiseGenerator default_noise;
+
+float snoise(const Vector2 &v) { return default_noise.snoise(v); }
+float snoise(const Vector3 &v) { return default_noise.snoise(v); }
+float snoise(const Vector4 &v) { return default_noise.snoise(v); }
+
+void snoise_batch(const float *x, const float *y, float *out, int count) {
+    default_noise.snoise_batch(x, y, out, count);
+}
+
+void snoise_batch(const float *x, const float *y, const float *z, float *out, int count) {
+    default_noise.snoise_batch(x, y, z, out, count);
+}
+
+void snoise_grid(const Vector2 &origin, float frequency, int nx, int ny, float *out) {
+    default_noise.snoise_grid(origin, frequency, nx, ny, out);
+}
+
+void snoise_grid(const Vector3 &origin, float frequency, int nx, int ny, int nz, float *out) {
+    default_noise.snoise_grid(origin, frequency, nx, ny, nz, out);
+}
+
 float snoise_fractal(Vector3 v, int octaves, float lacunarity, float gain) {
-    return fractal_fbm(v, octaves, lacunarity, gain);
+    return default_noise.snoise_fractal(v, octaves, lacunarity, gain);
 }
 
 float snoise_fractal(Vector2 v, int octaves, float lacunarity, float gain) {
-    return fractal_fbm(v, octaves, lacunarity, gain);
+    return default_noise.snoise_fractal(v, octaves, lacunarity, gain);
 }
 
 float snoise_fractal_b(Vector3 v, int octaves, float lacunarity, float gain) {
-    return fractal_b(v, octaves, lacunarity, gain);
+    return default_noise.snoise_fractal_b(v, octaves, lacunarity, gain);
 }
 
 float snoise_fractal_b(Vector2 v, int octaves, float lacunarity, float gain) {
-    return fractal_b(v, octaves, lacunarity, gain);
+    return default_noise.snoise_fractal_b(v, octaves, lacunarity, gain);
 }
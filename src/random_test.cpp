@@ -0,0 +1,257 @@
+#include "random.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <thread>
+
+#include "xmath.h"
+
+// Random coordinates over a range wide enough to cover negative cells
+// and the wrap around of the permutation table.
+static void random_points(Xorshift64 &rng, float *out, int count) {
+    for (int i = 0; i < count; ++i) {
+        out[i] = (rng.nextf() - 0.5f) * 1024.0f;
+    }
+}
+
+void test_snoise_batch_2d() {
+    // Not a multiple of 4 so the scalar tail is covered too
+    constexpr int N = 4099;
+    static float x[N], y[N], out[N];
+
+    Xorshift64 rng{1};
+    random_points(rng, x, N);
+    random_points(rng, y, N);
+    // Integer coordinates sit exactly on the cell corners
+    for (int i = 0; i < 64; ++i) {
+        x[i] = float(i - 32);
+        y[i] = float(32 - i);
+    }
+
+    snoise_batch(x, y, out, N);
+    for (int i = 0; i < N; ++i) {
+        float expected = snoise(Vector2(x[i], y[i]));
+        assert(memcmp(&out[i], &expected, sizeof(float)) == 0);
+    }
+}
+
+void test_snoise_batch_3d() {
+    constexpr int N = 4099;
+    static float x[N], y[N], z[N], out[N];
+
+    Xorshift64 rng{2};
+    random_points(rng, x, N);
+    random_points(rng, y, N);
+    random_points(rng, z, N);
+    for (int i = 0; i < 64; ++i) {
+        x[i] = float(i - 32);
+        y[i] = float(i % 7);
+        z[i] = float(32 - i);
+    }
+
+    snoise_batch(x, y, z, out, N);
+    for (int i = 0; i < N; ++i) {
+        float expected = snoise(Vector3(x[i], y[i], z[i]));
+        assert(memcmp(&out[i], &expected, sizeof(float)) == 0);
+    }
+}
+
+void test_snoise_grid_2d() {
+    // Odd sizes cover the scalar tail, the origins cover negative cells
+    // and frequencies too high for the corner table.
+    const Vector2 origins[] = {Vector2(0, 0), Vector2(-48, 32), Vector2(1000.5f, -77.25f)};
+    const float frequencies[] = {1.0f / 64, 0.37f, 1.0f, 500.0f};
+    constexpr int NX = 17, NY = 19;
+    float out[NX * NY];
+
+    for (auto origin : origins) {
+        for (float frequency : frequencies) {
+            snoise_grid(origin, frequency, NX, NY, out);
+            for (int i = 0; i < NX; ++i) {
+                for (int j = 0; j < NY; ++j) {
+                    float expected = snoise((origin + Vector2(float(i), float(j))) * frequency);
+                    assert(memcmp(&out[i * NY + j], &expected, sizeof(float)) == 0);
+                }
+            }
+        }
+    }
+}
+
+void test_snoise_grid_3d() {
+    const Vector3 origins[] = {Vector3(0, 0, 0), Vector3(-48, 7, 32), Vector3(1000.5f, -77.25f, 3)};
+    const float frequencies[] = {1.0f / 32, 0.37f, 1.0f, 500.0f};
+    constexpr int NX = 9, NY = 11, NZ = 13;
+    float out[NX * NY * NZ];
+
+    for (auto origin : origins) {
+        for (float frequency : frequencies) {
+            snoise_grid(origin, frequency, NX, NY, NZ, out);
+            for (int i = 0; i < NX; ++i) {
+                for (int j = 0; j < NY; ++j) {
+                    for (int k = 0; k < NZ; ++k) {
+                        Vector3 p = (origin + Vector3(float(i), float(j), float(k))) * frequency;
+                        float expected = snoise(p);
+                        assert(memcmp(&out[(i * NY + j) * NZ + k], &expected, sizeof(float)) == 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void test_noise_generator() {
+    NoiseGenerator reference;
+    NoiseGenerator a{42};
+    NoiseGenerator b{42};
+    NoiseGenerator c{43};
+
+    int differ = 0;
+    for (int i = 0; i < 256; ++i) {
+        auto p = Vector3(float(i) * 0.37f, float(i % 13) * 0.61f, float(i) * -0.23f);
+        assert(reference.snoise(p) == snoise(p));
+        assert(a.snoise(p) == b.snoise(p));
+        differ += a.snoise(p) != c.snoise(p);
+    }
+    assert(differ > 200);
+
+    // Seeding a generator must not affect the others
+    NoiseGenerator{7};
+    assert(reference.snoise(Vector2(0.5f, 0.25f)) == snoise(Vector2(0.5f, 0.25f)));
+}
+
+void test_noise_generator_threads() {
+    // Generators with different seeds used from several threads at once
+    // must match the same generators used one at a time.
+    constexpr int Threads = 4;
+    constexpr int N = 16 * 16 * 64;
+    static float expected[Threads][N];
+    static float results[Threads][N];
+
+    std::vector<NoiseGenerator> generators;
+    for (int t = 0; t < Threads; ++t) {
+        generators.emplace_back(uint64_t(t + 1));
+        generators[t].snoise_grid(Vector3(-8, 0, 24), 1.0f / 32, 16, 64, 16, expected[t]);
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < Threads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int r = 0; r < 8; ++r) {
+                generators[t].snoise_grid(Vector3(-8, 0, 24), 1.0f / 32, 16, 64, 16, results[t]);
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    for (int t = 0; t < Threads; ++t) {
+        assert(memcmp(expected[t], results[t], sizeof(expected[t])) == 0);
+    }
+}
+
+template <typename F>
+static double time_us(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+void bench_snoise() {
+    constexpr int N = 1 << 16;
+    constexpr int Rounds = 16;
+    static float x[N], y[N], z[N], out[N];
+
+    Xorshift64 rng{3};
+    random_points(rng, x, N);
+    random_points(rng, y, N);
+    random_points(rng, z, N);
+
+    // Keeps the results alive
+    float sum = 0;
+
+    double scalar_2d = time_us([&] {
+        for (int r = 0; r < Rounds; ++r) {
+            for (int i = 0; i < N; ++i) out[i] = snoise(Vector2(x[i], y[i]));
+            sum += out[r];
+        }
+    });
+    double batch_2d = time_us([&] {
+        for (int r = 0; r < Rounds; ++r) {
+            snoise_batch(x, y, out, N);
+            sum += out[r];
+        }
+    });
+    double scalar_3d = time_us([&] {
+        for (int r = 0; r < Rounds; ++r) {
+            for (int i = 0; i < N; ++i) out[i] = snoise(Vector3(x[i], y[i], z[i]));
+            sum += out[r];
+        }
+    });
+    double batch_3d = time_us([&] {
+        for (int r = 0; r < Rounds; ++r) {
+            snoise_batch(x, y, z, out, N);
+            sum += out[r];
+        }
+    });
+
+    auto report = [](const char *name, double us) {
+        printf("[BENCH] %-10s %8.2f ns/sample\n", name, us * 1000.0 / (double(N) * Rounds));
+    };
+    report("2d scalar", scalar_2d);
+    report("2d batch", batch_2d);
+    report("3d scalar", scalar_3d);
+    report("3d batch", batch_3d);
+    printf("[BENCH] checksum %f\n", sum);
+}
+
+// Heightmaps of 16x16 chunks the way load_chunk samples them
+void bench_snoise_grid() {
+    constexpr int Chunks = 4096;
+    constexpr int Columns = 16 * 16;
+    static float xs[Columns], ys[Columns], out[Columns];
+    float sum = 0;
+
+    double batch = time_us([&] {
+        for (int c = 0; c < Chunks; ++c) {
+            auto origin = Vector2(float(c % 64 * 16), float(c / 64 * 16));
+            for (int i = 0; i < 16; ++i) {
+                for (int j = 0; j < 16; ++j) {
+                    xs[i * 16 + j] = (origin.x + float(i)) / 64;
+                    ys[i * 16 + j] = (origin.y + float(j)) / 64;
+                }
+            }
+            snoise_batch(xs, ys, out, Columns);
+            sum += out[c % Columns];
+        }
+    });
+    double grid = time_us([&] {
+        for (int c = 0; c < Chunks; ++c) {
+            auto origin = Vector2(float(c % 64 * 16), float(c / 64 * 16));
+            snoise_grid(origin, 1.0f / 64, 16, 16, out);
+            sum += out[c % Columns];
+        }
+    });
+
+    printf("[BENCH] heightmap batch %8.2f us/chunk\n", batch / Chunks);
+    printf("[BENCH] heightmap grid  %8.2f us/chunk\n", grid / Chunks);
+    printf("[BENCH] checksum %f\n", sum);
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_snoise_batch_2d();
+    test_snoise_batch_3d();
+    test_snoise_grid_2d();
+    test_snoise_grid_3d();
+    test_noise_generator();
+    test_noise_generator_threads();
+
+    bench_snoise();
+    bench_snoise_grid();
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "range_allocator.h"
+
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+RangeAllocator::RangeAllocator(uint32_t capacity) : total{capacity} {
+    if (capacity > 0) free_list.push_back({0, capacity});
+}
+
+uint32_t RangeAllocator::allocate(uint32_t size) {
+    assert(size > 0);
+
+    // Best fit, there are rarely more than a few hundred free ranges
+    size_t best = free_list.size();
+    for (size_t i = 0; i < free_list.size(); ++i) {
+        if (free_list[i].size < size) continue;
+        if (best == free_list.size() || free_list[i].size < free_list[best].size) {
+            best = i;
+            if (free_list[i].size == size) break;
+        }
+    }
+    if (best == free_list.size()) return Invalid;
+
+    auto &range = free_list[best];
+    uint32_t offset = range.offset;
+    range.offset += size;
+    range.size -= size;
+    if (range.size == 0) free_list.erase(free_list.begin() + best);
+
+    in_use += size;
+    return offset;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size) {
+    assert(size > 0 && offset + size <= total && size <= in_use);
+    in_use -= size;
+
+    // First free range after the freed one
+    auto next = std::lower_bound(free_list.begin(), free_list.end(), offset,
+                                 [](const Range &r, uint32_t o) { return r.offset < o; });
+    assert(next == free_list.end() || offset + size <= next->offset);
+
+    bool merge_prev = next != free_list.begin() && (next - 1)->offset + (next - 1)->size == offset;
+    bool merge_next = next != free_list.end() && offset + size == next->offset;
+    assert(next == free_list.begin() || (next - 1)->offset + (next - 1)->size <= offset);
+
+    if (merge_prev && merge_next) {
+        (next - 1)->size += size + next->size;
+        free_list.erase(next);
+    } else if (merge_prev) {
+        (next - 1)->size += size;
+    } else if (merge_next) {
+        next->offset = offset;
+        next->size += size;
+    } else {
+        free_list.insert(next, {offset, size});
+    }
+}
+
+void RangeAllocator::grow(uint32_t new_capacity) {
+    assert(new_capacity >= total);
+    if (new_capacity == total) return;
+
+    uint32_t added = new_capacity - total;
+    if (!free_list.empty() && free_list.back().offset + free_list.back().size == total) {
+        free_list.back().size += added;
+    } else {
+        free_list.push_back({total, added});
+    }
+    total = new_capacity;
+}
+
+uint32_t RangeAllocator::largest_free() const {
+    uint32_t largest = 0;
+    for (const auto &range : free_list) largest = std::max(largest, range.size);
+    return largest;
+}
@@ -0,0 +1,54 @@
+#ifndef RANGE_ALLOCATOR_H
+#define RANGE_ALLOCATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Hands out ranges of a buffer of `capacity` units, such as the single
+// GPU buffer holding every chunk mesh. Only offsets are tracked, the
+// buffer itself is never touched, so it works and can be tested without
+// a GPU.
+//
+// Free ranges are kept sorted by offset and merged with their neighbors
+// when freed. Allocations take the smallest free range they fit in,
+// leaving the large ranges for large meshes.
+class RangeAllocator {
+public:
+    static constexpr uint32_t Invalid = UINT32_MAX;
+
+    explicit RangeAllocator(uint32_t capacity = 0);
+
+    // Returns the offset of `size` free units, or Invalid if no free
+    // range is large enough. `size` must not be 0.
+    uint32_t allocate(uint32_t size);
+
+    // Frees a range returned by allocate
+    void free(uint32_t offset, uint32_t size);
+
+    // Extends the buffer to `new_capacity` units, at least the current
+    // capacity. Allocated ranges keep their offsets.
+    void grow(uint32_t new_capacity);
+
+    uint32_t capacity() const { return total; }
+    uint32_t used() const { return in_use; }
+
+    // Size of the largest range allocate can return
+    uint32_t largest_free() const;
+
+    // Number of separate free ranges, 1 when there is no fragmentation
+    size_t fragments() const { return free_list.size(); }
+
+private:
+    struct Range {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    // Sorted by offset, never adjacent to each other
+    std::vector<Range> free_list;
+    uint32_t total;
+    uint32_t in_use = 0;
+};
+
+#endif // RANGE_ALLOCATOR_H
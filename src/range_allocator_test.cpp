@@ -0,0 +1,122 @@
+#include "range_allocator.h"
+
+#include <cstdio>
+#include <cassert>
+#include <vector>
+
+#include "random.h"
+
+void test_allocate_free() {
+    RangeAllocator ranges{100};
+
+    uint32_t a = ranges.allocate(30);
+    uint32_t b = ranges.allocate(30);
+    uint32_t c = ranges.allocate(30);
+    assert(a == 0 && b == 30 && c == 60);
+    assert(ranges.used() == 90);
+    assert(ranges.allocate(11) == RangeAllocator::Invalid);
+
+    // Freeing the middle leaves a hole, freeing its neighbors merges
+    // everything back into one range
+    ranges.free(b, 30);
+    assert(ranges.fragments() == 2 && ranges.largest_free() == 30);
+    ranges.free(a, 30);
+    assert(ranges.fragments() == 2 && ranges.largest_free() == 60);
+    ranges.free(c, 30);
+    assert(ranges.fragments() == 1 && ranges.largest_free() == 100);
+    assert(ranges.used() == 0);
+}
+
+void test_best_fit() {
+    RangeAllocator ranges{100};
+    uint32_t sizes[5] = {30, 10, 20, 10, 30};
+    uint32_t offsets[5];
+    for (int i = 0; i < 5; ++i) offsets[i] = ranges.allocate(sizes[i]);
+
+    // Holes of 30, 20 and 30
+    ranges.free(offsets[0], 30);
+    ranges.free(offsets[2], 20);
+    ranges.free(offsets[4], 30);
+
+    // The exact fit is taken rather than the first fit
+    assert(ranges.allocate(20) == 40);
+    assert(ranges.allocate(25) == 0);
+    assert(ranges.allocate(30) == 70);
+    assert(ranges.allocate(5) == 25);
+    assert(ranges.largest_free() == 0);
+}
+
+void test_grow() {
+    RangeAllocator ranges{64};
+    uint32_t a = ranges.allocate(64);
+    assert(ranges.allocate(32) == RangeAllocator::Invalid);
+
+    ranges.grow(128);
+    assert(ranges.allocate(32) == 64);
+    assert(ranges.capacity() == 128);
+
+    // A free range at the end is extended rather than split in two
+    ranges.grow(256);
+    assert(ranges.fragments() == 1 && ranges.largest_free() == 160);
+
+    ranges.free(a, 64);
+    assert(ranges.fragments() == 2);
+}
+
+// Random allocations and frees, checked against a map of the buffer
+void test_random() {
+    constexpr uint32_t Capacity = 4096;
+    RangeAllocator ranges{Capacity};
+    std::vector<int> owner(Capacity, -1);
+
+    struct Allocation {
+        uint32_t offset;
+        uint32_t size;
+    };
+    std::vector<Allocation> live;
+
+    Xorshift64 rng{11};
+    for (int i = 0; i < 20000; ++i) {
+        if (live.empty() || rng.nexti64() % 3 != 0) {
+            auto size = uint32_t(1 + rng.nexti64() % 100);
+            uint32_t offset = ranges.allocate(size);
+            if (offset == RangeAllocator::Invalid) {
+                assert(ranges.largest_free() < size);
+                continue;
+            }
+            for (uint32_t j = offset; j < offset + size; ++j) {
+                assert(owner[j] == -1);
+                owner[j] = i;
+            }
+            live.push_back({offset, size});
+        } else {
+            size_t k = size_t(rng.nexti64() % live.size());
+            auto allocation = live[k];
+            live[k] = live.back();
+            live.pop_back();
+
+            ranges.free(allocation.offset, allocation.size);
+            for (uint32_t j = allocation.offset; j < allocation.offset + allocation.size; ++j) {
+                owner[j] = -1;
+            }
+        }
+    }
+
+    uint32_t used = 0;
+    for (int o : owner) used += o != -1;
+    assert(ranges.used() == used);
+
+    for (const auto &allocation : live) ranges.free(allocation.offset, allocation.size);
+    assert(ranges.used() == 0 && ranges.fragments() == 1);
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_allocate_free();
+    test_best_fit();
+    test_grow();
+    test_random();
+}
+
+#endif
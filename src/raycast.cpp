@@ -0,0 +1,285 @@
+#include "raycast.h"
+
+#include <cmath>
+#include <cstdint>
+
+#include "xmath.h"
+#include "math_simd.h"
+#include "chunk.h"
+#include "chunk_map.h"
+
+static_assert((Chunk_SizeX & (Chunk_SizeX - 1)) == 0 && (Chunk_SizeZ & (Chunk_SizeZ - 1)) == 0,
+              "Chunk sizes must be powers of two to find chunks with shifts");
+
+constexpr int Chunk_ShiftX = 4;
+constexpr int Chunk_ShiftZ = 4;
+static_assert(1 << Chunk_ShiftX == Chunk_SizeX && 1 << Chunk_ShiftZ == Chunk_SizeZ, "Chunk shifts");
+
+// Looks up voxels along a ray, keeping the chunk of the last lookup as
+// consecutive voxels are nearly always in the same chunk
+struct VoxelCursor {
+    const ChunkMap *chunks;
+    const Chunk *chunk = nullptr;
+    Point3 position = Point3(0);
+    bool valid = false;
+
+    Voxel get(const Point3 &voxel) {
+        if (voxel.y < 0 || voxel.y >= Chunk_SizeY) return Voxel_Air;
+
+        auto chunk_position = Point3(voxel.x >> Chunk_ShiftX, 0, voxel.z >> Chunk_ShiftZ);
+        if (!valid || chunk_position != position) {
+            chunk = chunks->find(chunk_position);
+            position = chunk_position;
+            valid = true;
+        }
+        if (chunk == nullptr) return Voxel_Air;
+
+        return chunk->get(voxel.x & (Chunk_SizeX - 1), voxel.y, voxel.z & (Chunk_SizeZ - 1));
+    }
+};
+
+// Initial state of the DDA for a ray
+struct RayStart {
+    // Normalized ray direction
+    Vector3 direction;
+    // Voxel containing the origin
+    Point3 voxel;
+    // Direction of the steps along each axis, -1, 0 or 1
+    Point3 step;
+    // Distance along the ray to the next voxel boundary on each axis,
+    // and between two boundaries of the same axis
+    Vector3 t_max;
+    Vector3 t_delta;
+    // Ray::max_distance clamped to Ray_DistanceLimit
+    float max_distance;
+};
+
+// Returns false if the ray has no direction or a NaN max_distance
+static bool start_ray(const Ray &ray, RayStart *start) {
+    float length = math::length(ray.direction);
+    if (!(length > 0.0f) || std::isnan(ray.max_distance)) return false;
+    start->max_distance = fminf(ray.max_distance, Ray_DistanceLimit);
+    start->direction = ray.direction / length;
+
+    // In corner space voxel v spans [v, v + 1], so the voxel of a point
+    // is its floor
+    Vector3 p = ray.origin + 0.5f;
+
+    for (int i = 0; i < 3; ++i) {
+        float d = start->direction[i];
+        float cell = floorf(p[i]);
+        start->voxel[i] = int(cell);
+
+        if (d > 0.0f) {
+            start->step[i] = 1;
+            start->t_delta[i] = 1.0f / d;
+            start->t_max[i] = (cell + 1.0f - p[i]) / d;
+        } else if (d < 0.0f) {
+            start->step[i] = -1;
+            start->t_delta[i] = -1.0f / d;
+            start->t_max[i] = (p[i] - cell) / -d;
+        } else {
+            start->step[i] = 0;
+            start->t_delta[i] = INFINITY;
+            start->t_max[i] = INFINITY;
+        }
+    }
+    return true;
+}
+
+// True once the ray is above or below the chunks and moving away
+static bool leaving_world(int y, int step_y) {
+    return (y < 0 && step_y <= 0) || (y >= Chunk_SizeY && step_y >= 0);
+}
+
+static void set_hit(const Ray &ray, const Vector3 &direction, const Point3 &voxel, Voxel type,
+                    const Point3 &normal, float t, RayHit *hit) {
+    hit->voxel = voxel;
+    hit->type = type;
+    hit->normal = normal;
+    hit->position = ray.origin + direction * t;
+    hit->distance = t;
+}
+
+bool raycast(const ChunkMap &chunks, const Ray &ray, RayHit *hit) {
+    RayStart s;
+    if (!start_ray(ray, &s)) return false;
+
+    VoxelCursor cursor{&chunks};
+    Point3 normal(0);
+    float t = 0.0f;
+
+    for (;;) {
+        if (leaving_world(s.voxel.y, s.step.y)) return false;
+
+        Voxel voxel = cursor.get(s.voxel);
+        if (voxel != Voxel_Air) {
+            set_hit(ray, s.direction, s.voxel, voxel, normal, t, hit);
+            return true;
+        }
+
+        // Step into the neighbor across the nearest boundary
+        int axis = s.t_max.x <= s.t_max.y && s.t_max.x <= s.t_max.z ? 0
+                 : s.t_max.y <= s.t_max.z ? 1 : 2;
+        t = s.t_max[axis];
+        if (t > s.max_distance) return false;
+
+        s.voxel[axis] += s.step[axis];
+        s.t_max[axis] += s.t_delta[axis];
+        normal = Point3(0);
+        normal[axis] = -s.step[axis];
+    }
+}
+
+#ifdef MATH_ARCH_SSE2
+
+// Walks 4 rays at once. The DDA state of each ray is kept in one lane of
+// SSE registers and every iteration steps all rays along their nearest
+// boundary with masks instead of branches. Only the voxel lookups are
+// done one lane at a time.
+static void raycast_packet(const ChunkMap &chunks, const Ray *rays, RayHit *hits, uint8_t *hit) {
+    RayStart starts[4];
+    VoxelCursor cursors[4];
+
+    alignas(16) int32_t voxel_x[4], voxel_y[4], voxel_z[4];
+    alignas(16) int32_t step_x[4], step_y[4], step_z[4];
+    alignas(16) float t_max_x[4], t_max_y[4], t_max_z[4];
+    alignas(16) float t_delta_x[4], t_delta_y[4], t_delta_z[4];
+    alignas(16) float max_distance[4];
+
+    int active = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+        hit[lane] = 0;
+        cursors[lane].chunks = &chunks;
+
+        auto &s = starts[lane];
+        if (start_ray(rays[lane], &s)) {
+            active |= 1 << lane;
+        } else {
+            // Parked, the lane never looks anything up
+            s.voxel = Point3(0);
+            s.step = Point3(0);
+            s.t_max = Vector3(INFINITY);
+            s.t_delta = Vector3(INFINITY);
+            s.max_distance = 0.0f;
+        }
+
+        voxel_x[lane] = s.voxel.x;
+        voxel_y[lane] = s.voxel.y;
+        voxel_z[lane] = s.voxel.z;
+        step_x[lane] = s.step.x;
+        step_y[lane] = s.step.y;
+        step_z[lane] = s.step.z;
+        t_max_x[lane] = s.t_max.x;
+        t_max_y[lane] = s.t_max.y;
+        t_max_z[lane] = s.t_max.z;
+        t_delta_x[lane] = s.t_delta.x;
+        t_delta_y[lane] = s.t_delta.y;
+        t_delta_z[lane] = s.t_delta.z;
+        max_distance[lane] = s.max_distance;
+    }
+
+    __m128i vx = _mm_load_si128((const __m128i *)voxel_x);
+    __m128i vy = _mm_load_si128((const __m128i *)voxel_y);
+    __m128i vz = _mm_load_si128((const __m128i *)voxel_z);
+    __m128i sx = _mm_load_si128((const __m128i *)step_x);
+    __m128i sy = _mm_load_si128((const __m128i *)step_y);
+    __m128i sz = _mm_load_si128((const __m128i *)step_z);
+    __m128 tx = _mm_load_ps(t_max_x);
+    __m128 ty = _mm_load_ps(t_max_y);
+    __m128 tz = _mm_load_ps(t_max_z);
+    __m128 dx = _mm_load_ps(t_delta_x);
+    __m128 dy = _mm_load_ps(t_delta_y);
+    __m128 dz = _mm_load_ps(t_delta_z);
+    __m128 max_t = _mm_load_ps(max_distance);
+
+    __m128 t = _mm_setzero_ps();
+    __m128i nx = _mm_setzero_si128();
+    __m128i ny = _mm_setzero_si128();
+    __m128i nz = _mm_setzero_si128();
+
+    while (active != 0) {
+        _mm_store_si128((__m128i *)voxel_x, vx);
+        _mm_store_si128((__m128i *)voxel_y, vy);
+        _mm_store_si128((__m128i *)voxel_z, vz);
+
+        int found = 0;
+        Voxel types[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            if (!(active & (1 << lane))) continue;
+
+            if (leaving_world(voxel_y[lane], step_y[lane])) {
+                active &= ~(1 << lane);
+                continue;
+            }
+
+            types[lane] = cursors[lane].get(Point3(voxel_x[lane], voxel_y[lane], voxel_z[lane]));
+            if (types[lane] != Voxel_Air) found |= 1 << lane;
+        }
+
+        if (found != 0) {
+            alignas(16) float ts[4];
+            alignas(16) int32_t normal_x[4], normal_y[4], normal_z[4];
+            _mm_store_ps(ts, t);
+            _mm_store_si128((__m128i *)normal_x, nx);
+            _mm_store_si128((__m128i *)normal_y, ny);
+            _mm_store_si128((__m128i *)normal_z, nz);
+
+            for (int lane = 0; lane < 4; ++lane) {
+                if (!(found & (1 << lane))) continue;
+
+                set_hit(rays[lane], starts[lane].direction,
+                        Point3(voxel_x[lane], voxel_y[lane], voxel_z[lane]), types[lane],
+                        Point3(normal_x[lane], normal_y[lane], normal_z[lane]), ts[lane],
+                        &hits[lane]);
+                hit[lane] = 1;
+            }
+            active &= ~found;
+        }
+        if (active == 0) break;
+
+        // Masks of the axis each ray steps along, with the same tie
+        // breaking as raycast
+        __m128 step_on_x = _mm_and_ps(_mm_cmple_ps(tx, ty), _mm_cmple_ps(tx, tz));
+        __m128 step_on_y = _mm_andnot_ps(step_on_x, _mm_cmple_ps(ty, tz));
+        __m128 step_on_z = _mm_andnot_ps(_mm_or_ps(step_on_x, step_on_y),
+                                         _mm_castsi128_ps(_mm_set1_epi32(-1)));
+
+        t = _mm_or_ps(_mm_and_ps(step_on_x, tx),
+                      _mm_or_ps(_mm_and_ps(step_on_y, ty), _mm_and_ps(step_on_z, tz)));
+        active &= ~_mm_movemask_ps(_mm_cmpgt_ps(t, max_t));
+
+        __m128i mask_x = _mm_castps_si128(step_on_x);
+        __m128i mask_y = _mm_castps_si128(step_on_y);
+        __m128i mask_z = _mm_castps_si128(step_on_z);
+
+        vx = _mm_add_epi32(vx, _mm_and_si128(sx, mask_x));
+        vy = _mm_add_epi32(vy, _mm_and_si128(sy, mask_y));
+        vz = _mm_add_epi32(vz, _mm_and_si128(sz, mask_z));
+
+        tx = _mm_add_ps(tx, _mm_and_ps(dx, step_on_x));
+        ty = _mm_add_ps(ty, _mm_and_ps(dy, step_on_y));
+        tz = _mm_add_ps(tz, _mm_and_ps(dz, step_on_z));
+
+        nx = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(sx, mask_x));
+        ny = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(sy, mask_y));
+        nz = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(sz, mask_z));
+    }
+}
+
+#endif
+
+void raycast_batch(const ChunkMap &chunks, const Ray *rays, size_t count,
+                   RayHit *hits, uint8_t *hit) {
+    size_t i = 0;
+
+#ifdef MATH_ARCH_SSE2
+    for (; i + 4 <= count; i += 4) {
+        raycast_packet(chunks, rays + i, hits + i, hit + i);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        hit[i] = raycast(chunks, rays[i], &hits[i]);
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "xmath.h"
+#include "voxel.h"
+
+class ChunkMap;
+
+// Rays never go further than this, so a ray with an infinite
+// max_distance still ends when it runs through air or unloaded chunks
+constexpr float Ray_DistanceLimit = 4096.0f;
+
+struct Ray {
+    // World space, voxel centers are on integer coordinates
+    Vector3 origin;
+    // Does not need to be normalized
+    Vector3 direction;
+    // Solid voxels further than this along the ray are not hit. Clamped
+    // to Ray_DistanceLimit, a ray with a NaN max_distance hits nothing.
+    float max_distance = Ray_DistanceLimit;
+};
+
+struct RayHit {
+    // World voxel coordinates of the solid voxel hit
+    Point3 voxel;
+    Voxel type;
+    // Normal of the face the ray entered the voxel through, such that
+    // voxel + normal is the air voxel in front of it. Zero if the ray
+    // starts inside the voxel.
+    Point3 normal;
+    // Point where the ray enters the voxel and its distance from the
+    // ray origin
+    Vector3 position;
+    float distance;
+};
+
+// Finds the first solid voxel along the ray, walking the voxels it
+// crosses one at a time with the DDA of Amanatides and Woo, "A Fast Voxel
+// Traversal Algorithm for Ray Tracing". Chunks that are not loaded are
+// treated as air. Returns false if nothing is hit within the ray's
+// max_distance.
+bool raycast(const ChunkMap &chunks, const Ray &ray, RayHit *hit);
+
+// Traces `count` rays, setting hit[i] to 1 and filling hits[i] if ray i
+// hits a voxel, and hit[i] to 0 otherwise. Gives the same results as
+// raycast for each ray.
+//
+// Rays are walked 4 at a time with SSE, choosing the axis to step along
+// and advancing all 4 rays at once without branches. It is fastest when
+// neighboring rays are coherent, such as rays through adjacent pixels,
+// as they then tend to look into the same chunks.
+void raycast_batch(const ChunkMap &chunks, const Ray *rays, size_t count,
+                   RayHit *hits, uint8_t *hit);
+
+#endif // RAYCAST_H
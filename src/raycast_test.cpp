@@ -0,0 +1,191 @@
+#include "raycast.h"
+
+#include <cstdio>
+#include <cassert>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "xmath.h"
+#include "chunk.h"
+#include "chunk_map.h"
+#include "terrain.h"
+#include "random.h"
+
+static bool near(float a, float b) {
+    return fabsf(a - b) < 1e-4f;
+}
+
+static void free_chunks(ChunkMap *chunks) {
+    for (auto *chunk : *chunks) unload_chunk(chunk);
+    chunks->clear();
+}
+
+void test_raycast_hits() {
+    ChunkMap chunks;
+    auto *chunk = alloc_chunk(Point3(0, 0, 0));
+    auto *east = alloc_chunk(Point3(1, 0, 0));
+    auto *west = alloc_chunk(Point3(-1, 0, 0));
+    chunks.insert(chunk);
+    chunks.insert(east);
+    chunks.insert(west);
+
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            chunk->set(x, 10, z, Voxel_Stone);
+        }
+    }
+    east->set(4, 30, 4, Voxel_Wood);
+    west->set(Chunk_SizeX - 5, 30, 4, Voxel_Sand);
+
+    // Straight down onto the floor, entering through the top face
+    RayHit hit;
+    assert(raycast(chunks, {Vector3(3, 20, 5), Vector3(0, -2, 0), 100.0f}, &hit));
+    assert(hit.voxel == Point3(3, 10, 5) && hit.type == Voxel_Stone);
+    assert(hit.normal == Point3(0, 1, 0));
+    assert(near(hit.distance, 9.5f) && near(hit.position.y, 10.5f));
+
+    // Across chunk boundaries, both ways
+    assert(raycast(chunks, {Vector3(2, 30, 4), Vector3(1, 0, 0), 100.0f}, &hit));
+    assert(hit.voxel == Point3(20, 30, 4) && hit.type == Voxel_Wood);
+    assert(hit.normal == Point3(-1, 0, 0) && near(hit.distance, 17.5f));
+
+    assert(raycast(chunks, {Vector3(2, 30, 4), Vector3(-1, 0, 0), 100.0f}, &hit));
+    assert(hit.voxel == Point3(-5, 30, 4) && hit.type == Voxel_Sand);
+    assert(hit.normal == Point3(1, 0, 0) && near(hit.distance, 6.5f));
+
+    // A diagonal ray enters through whichever face it crosses last
+    assert(raycast(chunks, {Vector3(0, 15, 0), Vector3(1, -1, 0.5f), 100.0f}, &hit));
+    assert(hit.voxel.y == 10 && hit.normal == Point3(0, 1, 0));
+    assert(near(hit.position.y, 10.5f));
+
+    // Out of reach, no direction, and leaving the world
+    assert(!raycast(chunks, {Vector3(2, 30, 4), Vector3(1, 0, 0), 17.0f}, &hit));
+    assert(!raycast(chunks, {Vector3(2, 30, 4), Vector3(0, 0, 0), 100.0f}, &hit));
+    assert(!raycast(chunks, {Vector3(3, 20, 5), Vector3(0, 1, 0), 1000.0f}, &hit));
+
+    // Rays without a finite reach still end, or never start
+    assert(!raycast(chunks, {Vector3(2, 30, 4), Vector3(0, 0, 1), INFINITY}, &hit));
+    assert(!raycast(chunks, {Vector3(2, 30, 4), Vector3(1, 0, 1), NAN}, &hit));
+    assert(raycast(chunks, {Vector3(2, 30, 4), Vector3(1, 0, 0)}, &hit) && hit.type == Voxel_Wood);
+
+    // Starting inside a voxel hits it right away
+    assert(raycast(chunks, {Vector3(3, 10.2f, 5), Vector3(0, 1, 0), 100.0f}, &hit));
+    assert(hit.voxel == Point3(3, 10, 5) && hit.normal == Point3(0) && hit.distance == 0.0f);
+
+    free_chunks(&chunks);
+}
+
+static void load_terrain(ChunkMap *chunks, int radius) {
+    static TerrainGenerator terrain{7};
+    for (int x = -radius; x <= radius; ++x) {
+        for (int z = -radius; z <= radius; ++z) {
+            chunks->insert(terrain.generate(Point3(x, 0, z)));
+        }
+    }
+}
+
+void test_raycast_batch() {
+    ChunkMap chunks;
+    load_terrain(&chunks, 1);
+
+    // Random rays, including some without direction and a count that
+    // is not a multiple of the packet size
+    constexpr int N = 1001;
+    std::vector<Ray> rays(N);
+    Xorshift64 rng{5};
+    for (auto &ray : rays) {
+        ray.origin = rng.next3(Vector3(-24, 0, -24), Vector3(40, 120, 40));
+        ray.direction = rng.next3(Vector3(-1), Vector3(1));
+        ray.max_distance = rng.nextf(0.0f, 200.0f);
+    }
+    rays[17].direction = Vector3(0);
+    rays[18].direction = Vector3(0, -1, 0);
+    rays[19].max_distance = INFINITY;
+    rays[20].max_distance = NAN;
+    rays[21].direction = Vector3(1, 0, 0);
+    rays[21].max_distance = INFINITY;
+
+    std::vector<RayHit> hits(N);
+    std::vector<uint8_t> hit(N);
+    raycast_batch(chunks, rays.data(), N, hits.data(), hit.data());
+
+    int n_hits = 0;
+    for (int i = 0; i < N; ++i) {
+        RayHit expected;
+        bool expected_hit = raycast(chunks, rays[i], &expected);
+        assert(hit[i] == expected_hit);
+        if (!expected_hit) continue;
+
+        ++n_hits;
+        assert(hits[i].voxel == expected.voxel && hits[i].type == expected.type);
+        assert(hits[i].normal == expected.normal);
+        assert(hits[i].distance == expected.distance);
+        assert(hits[i].position == expected.position);
+    }
+    assert(n_hits > 0 && n_hits < N);
+
+    free_chunks(&chunks);
+}
+
+// Rays through the pixels of a camera looking down over the terrain,
+// neighboring rays are coherent
+static void make_camera_rays(std::vector<Ray> *rays, int width, int height) {
+    auto origin = Vector3(8, 90, 8);
+    auto front = math::normalize(Vector3(1, -0.6f, 0.3f));
+    auto right = math::normalize(math::cross(front, Vector3(0, 1, 0)));
+    auto up = math::cross(right, front);
+
+    rays->clear();
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float u = (x + 0.5f) / width * 2.0f - 1.0f;
+            float v = (y + 0.5f) / height * 2.0f - 1.0f;
+            rays->push_back({origin, front + right * u + up * (v * 0.75f), 160.0f});
+        }
+    }
+}
+
+void bench_raycast() {
+    ChunkMap chunks;
+    load_terrain(&chunks, 6);
+
+    std::vector<Ray> rays;
+    make_camera_rays(&rays, 256, 256);
+    std::vector<RayHit> hits(rays.size());
+    std::vector<uint8_t> hit(rays.size());
+
+    constexpr int N = 8;
+    size_t n_hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i) {
+        for (size_t r = 0; r < rays.size(); ++r) {
+            n_hits += raycast(chunks, rays[r], &hits[r]);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double scalar_ns = std::chrono::duration<double, std::nano>(end - start).count() / (N * rays.size());
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i) {
+        raycast_batch(chunks, rays.data(), rays.size(), hits.data(), hit.data());
+    }
+    end = std::chrono::steady_clock::now();
+    double batch_ns = std::chrono::duration<double, std::nano>(end - start).count() / (N * rays.size());
+
+    printf("[BENCH] raycast  %6.1f ns/ray  batch %6.1f ns/ray  %zu rays, %.0f%% hit\n",
+           scalar_ns, batch_ns, rays.size(), 100.0 * n_hits / (N * rays.size()));
+
+    free_chunks(&chunks);
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_raycast_hits();
+    test_raycast_batch();
+
+    bench_raycast();
+}
+
+#endif
@@ -0,0 +1,401 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "region.h"
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "xmath.h"
+#include "random.h"
+#include "chunk.h"
+#include "codec.h"
+
+static const char Region_Magic[4] = {'N', 'C', 'R', 'G'};
+constexpr uint32_t Region_Version = 2;
+
+// Magic, version then the entries
+constexpr size_t Region_HeaderSize = 8 + Region_Chunks * 3 * sizeof(uint32_t);
+
+// Space reserved for a chunk is rounded up to this, so chunks can grow
+// a little before they need to move
+constexpr uint32_t Region_Alignment = 256;
+
+static int floor_div(int a, int b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static Point2 region_position(const Point3 &chunk) {
+    return Point2(floor_div(chunk.x, Region_Size), floor_div(chunk.z, Region_Size));
+}
+
+static int region_index(const Point3 &chunk) {
+    int x = chunk.x - floor_div(chunk.x, Region_Size) * Region_Size;
+    int z = chunk.z - floor_div(chunk.z, Region_Size) * Region_Size;
+    return x * Region_Size + z;
+}
+
+RegionFile::~RegionFile() {
+    close();
+}
+
+bool RegionFile::open(const std::string &path) {
+    close();
+
+    file = fopen(path.c_str(), "r+b");
+    if (file == nullptr) {
+        // New region, write an empty table
+        file = fopen(path.c_str(), "w+b");
+        if (file == nullptr) return false;
+
+        memset(entries, 0, sizeof(entries));
+        fwrite(Region_Magic, 1, 4, file);
+        fwrite(&Region_Version, sizeof(Region_Version), 1, file);
+        fwrite(entries, sizeof(entries), 1, file);
+        if (fflush(file) != 0) {
+            close();
+            return false;
+        }
+    } else {
+        char magic[4];
+        uint32_t version = 0;
+        bool valid = fread(magic, 1, 4, file) == 4
+                  && fread(&version, sizeof(version), 1, file) == 1
+                  && fread(entries, sizeof(entries), 1, file) == 1
+                  && memcmp(magic, Region_Magic, 4) == 0
+                  && version == Region_Version;
+        if (!valid) {
+            close();
+            return false;
+        }
+    }
+
+    if (!remap()) {
+        close();
+        return false;
+    }
+
+    // Entries of a truncated file or a damaged table are dropped, their
+    // chunks are generated again
+    end = uint32_t(Region_HeaderSize);
+    for (auto &entry : entries) {
+        if (entry.size > 0 && !entry_in_file(entry)) {
+            fprintf(stderr, "Region: %s has a corrupted entry\n", path.c_str());
+            entry = Entry{};
+        }
+        if (entry.capacity > 0) end = std::max(end, entry.offset + entry.capacity);
+    }
+    return true;
+}
+
+bool RegionFile::entry_in_file(const Entry &entry) const {
+    return entry.offset >= Region_HeaderSize && entry.size <= entry.capacity
+        && size_t(entry.offset) + entry.size <= map_size;
+}
+
+void RegionFile::close() {
+    unmap();
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+#ifdef _WIN32
+
+bool RegionFile::remap() {
+    unmap();
+
+    auto handle = HANDLE(_get_osfhandle(_fileno(file)));
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) return false;
+
+    mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) return false;
+
+    map = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (map == nullptr) {
+        unmap();
+        return false;
+    }
+    map_size = size_t(size.QuadPart);
+    return true;
+}
+
+void RegionFile::unmap() {
+    if (map != nullptr) UnmapViewOfFile(map);
+    if (mapping != nullptr) CloseHandle(mapping);
+    map = nullptr;
+    mapping = nullptr;
+    map_size = 0;
+}
+
+#else
+
+bool RegionFile::remap() {
+    unmap();
+
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0) return false;
+
+    void *data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (data == MAP_FAILED) return false;
+
+    map = static_cast<const uint8_t *>(data);
+    map_size = size_t(st.st_size);
+    return true;
+}
+
+void RegionFile::unmap() {
+    if (map != nullptr) munmap(const_cast<uint8_t *>(map), map_size);
+    map = nullptr;
+    map_size = 0;
+}
+
+#endif
+
+Chunk *RegionFile::read(const Point3 &position) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (file == nullptr) return nullptr;
+
+    const auto &entry = entries[region_index(position)];
+    if (entry.size == 0) return nullptr;
+
+    if (size_t(entry.offset) + entry.size > map_size && !remap()) {
+        return nullptr;
+    }
+
+    // The file may have been truncated since it was opened
+    auto *chunk = alloc_chunk(position);
+    if (!entry_in_file(entry) || !decode_chunk(map + entry.offset, entry.size, chunk)) {
+        fprintf(stderr, "Region: Chunk (%d, %d) is corrupted\n", position.x, position.z);
+        unload_chunk(chunk);
+        return nullptr;
+    }
+    chunk->saved = true;
+    return chunk;
+}
+
+bool RegionFile::write(const Point3 &position, const uint8_t *data, size_t size) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (file == nullptr) return false;
+
+    int index = region_index(position);
+    Entry entry = entries[index];
+
+    if (size > entry.capacity) {
+        entry.offset = end;
+        entry.capacity = uint32_t((size + Region_Alignment - 1) / Region_Alignment * Region_Alignment);
+        end += entry.capacity;
+    }
+    entry.size = uint32_t(size);
+
+    // The chunk is written before the table points to it. A chunk moved
+    // to the end of the file leaves the old one readable if the write
+    // fails, but a chunk rewritten in place is lost.
+    bool ok = fseek(file, long(entry.offset), SEEK_SET) == 0
+           && fwrite(data, 1, size, file) == size
+           && fflush(file) == 0;
+
+    long entry_offset = long(8 + index * sizeof(Entry));
+    ok = ok && fseek(file, entry_offset, SEEK_SET) == 0
+            && fwrite(&entry, sizeof(entry), 1, file) == 1
+            && fflush(file) == 0;
+
+    if (ok) entries[index] = entry;
+    return ok;
+}
+
+RegionStore::~RegionStore() {
+    close();
+}
+
+bool RegionStore::open(const std::string &path) {
+    close();
+
+    std::error_code error;
+    std::filesystem::create_directories(path, error);
+    if (error) {
+        fprintf(stderr, "Region: Could not create %s: %s\n", path.c_str(), error.message().c_str());
+        return false;
+    }
+
+    directory = path;
+    writer.start(1);
+    return true;
+}
+
+void RegionStore::close() {
+    if (!is_open()) return;
+
+    writer.stop();
+    for (auto &region : regions) delete region.file;
+    regions.clear();
+    resident.clear();
+    resident_bytes = 0;
+    saves.clear();
+    directory.clear();
+}
+
+RegionFile *RegionStore::region(const Point3 &position) {
+    auto p = region_position(position);
+    for (const auto &region : regions) {
+        if (region.position == p) return region.file;
+    }
+
+    auto path = directory + "/r." + std::to_string(p.x) + "." + std::to_string(p.y) + ".ncr";
+    auto *file = new RegionFile;
+    if (!file->open(path)) {
+        fprintf(stderr, "Region: Could not open %s\n", path.c_str());
+        delete file;
+        return nullptr;
+    }
+    regions.push_back({p, file});
+    return file;
+}
+
+size_t RegionStore::PositionHash::operator()(const Point3 &position) const {
+    uint64_t key = uint64_t(uint32_t(position.x)) << 32 | uint32_t(position.z);
+    return size_t(SplitMix64{key ^ uint32_t(position.y)}.nexti64());
+}
+
+Chunk *RegionStore::load(const Point3 &position) {
+    if (!is_open()) return nullptr;
+
+    // Reused by every load on the thread
+    static thread_local std::vector<uint8_t> data;
+    data.clear();
+
+    RegionFile *file = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto it = resident.find(position);
+        if (it != resident.end()) {
+            // Copied to decode outside the lock
+            data.assign(it->second.data.begin(), it->second.data.end());
+        } else {
+            file = region(position);
+            if (file == nullptr) return nullptr;
+        }
+    }
+
+    if (data.empty()) {
+        // Region files are only closed with the store
+        return file->read(position);
+    }
+
+    auto *chunk = alloc_chunk(position);
+    bool ok = decode_chunk(data.data(), data.size(), chunk);
+    assert(ok && "RegionStore: Resident chunk does not decode");
+    (void)ok;
+    chunk->saved = true;
+    return chunk;
+}
+
+void RegionStore::save(const Chunk &chunk) {
+    if (!is_open()) return;
+
+    // Encoded into scratch then copied, so the kept data is allocated
+    // once at its final size
+    static thread_local std::vector<uint8_t> encoded;
+    encoded.clear();
+    encode_chunk(chunk, Codec_RLE_LZ, &encoded);
+    std::vector<uint8_t> data(encoded.begin(), encoded.end());
+
+    std::lock_guard<std::mutex> lock{mutex};
+
+    auto &entry = resident[chunk.position];
+
+    // A write already queued for the chunk picks up the new data
+    bool queued = !entry.data.empty() && !entry.written;
+
+    resident_bytes += data.size();
+    resident_bytes -= entry.data.size();
+    entry.data = std::move(data);
+    entry.version = ++next_version;
+    entry.written = false;
+    saves.push_back({chunk.position, entry.version});
+
+    if (!queued) {
+        auto position = chunk.position;
+        writer.submit([this, position] { write_pending(position); });
+    }
+    evict();
+}
+
+void RegionStore::write_pending(const Point3 &position) {
+    static thread_local std::vector<uint8_t> data;
+    uint64_t version = 0;
+    RegionFile *file;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        const auto &entry = resident.at(position);
+        data.assign(entry.data.begin(), entry.data.end());
+        version = entry.version;
+        file = region(position);
+    }
+
+    if (file == nullptr || !file->write(position, data.data(), data.size())) {
+        fprintf(stderr, "Region: Could not save chunk (%d, %d)\n", position.x, position.z);
+    }
+
+    std::lock_guard<std::mutex> lock{mutex};
+    auto &entry = resident.at(position);
+    if (entry.version == version) {
+        // The chunk may leave memory now
+        entry.written = true;
+        evict();
+    } else {
+        // Saved again while writing
+        writer.submit([this, position] { write_pending(position); });
+    }
+}
+
+void RegionStore::evict() {
+    // Chunks saved over and over would otherwise fill `saves` with old
+    // versions while within the budget
+    if (saves.size() > 2 * resident.size() + 64) {
+        auto stale = [&](const Saved &saved) {
+            auto it = resident.find(saved.position);
+            return it == resident.end() || it->second.version != saved.version;
+        };
+        saves.erase(std::remove_if(saves.begin(), saves.end(), stale), saves.end());
+    }
+
+    while (resident_bytes > memory_budget && !saves.empty()) {
+        auto saved = saves.front();
+        auto it = resident.find(saved.position);
+        if (it != resident.end() && it->second.version == saved.version) {
+            // Saves after this one are newer, nothing can be dropped
+            // until it is written
+            if (!it->second.written) return;
+
+            resident_bytes -= it->second.data.size();
+            resident.erase(it);
+        }
+        saves.pop_front();
+    }
+}
+
+size_t RegionStore::memory_usage() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return resident_bytes;
+}
+
+void RegionStore::flush() {
+    if (is_open()) writer.wait();
+}
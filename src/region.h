@@ -0,0 +1,179 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+
+#include "xmath.h"
+#include "jobs.h"
+
+struct Chunk;
+
+// Chunks are saved in region files holding Region_Size x Region_Size
+// chunk columns each
+constexpr int Region_Size = 32;
+constexpr int Region_Chunks = Region_Size * Region_Size;
+
+// A single region file. The file starts with a table giving the offset
+// and size of every chunk of the region, followed by the chunks encoded
+// with encode_chunk. A chunk is rewritten in place when it still fits in the space
+// it was given, otherwise it is moved to the end of the file. Entries
+// pointing outside the file are treated as corrupted.
+//
+// Chunks are read from a read only memory mapping of the file, so they
+// are decoded straight from the page cache. The mapping is extended when
+// a chunk written since the file was mapped is read.
+class RegionFile {
+public:
+    RegionFile() = default;
+
+    RegionFile(const RegionFile &) = delete;
+    RegionFile &operator=(const RegionFile &) = delete;
+
+    ~RegionFile();
+
+    // Opens the region file at `path`, creating an empty region if the
+    // file does not exist. Returns false if the file cannot be created or
+    // is not a region file.
+    bool open(const std::string &path);
+
+    void close();
+
+    // Returns a new chunk read from the file, or nullptr if the region
+    // has no chunk at `position`. Safe to call from several threads.
+    Chunk *read(const Point3 &position);
+
+    // Writes the encoded chunk `data` as the chunk at `position`. Safe to
+    // call from several threads.
+    bool write(const Point3 &position, const uint8_t *data, size_t size);
+
+private:
+    struct Entry {
+        uint32_t offset;
+        // 0 if the region has no chunk at this entry
+        uint32_t size;
+        // Bytes reserved for the chunk, it may grow up to this in place
+        uint32_t capacity;
+    };
+
+    std::mutex mutex;
+    FILE *file = nullptr;
+
+    // Copy of the table at the start of the file
+    Entry entries[Region_Chunks];
+
+    // Where the next chunk that does not fit in place is appended
+    uint32_t end = 0;
+
+    const uint8_t *map = nullptr;
+    size_t map_size = 0;
+#ifdef _WIN32
+    void *mapping = nullptr;
+#endif
+
+    // Maps the whole file again, after it has grown
+    bool remap();
+    void unmap();
+
+    // True if the chunk of `entry` lies within the mapping
+    bool entry_in_file(const Entry &entry) const;
+};
+
+// Chunks saved to disk, spread over the region files in a directory.
+// Saving encodes the chunk right away but the write happens on a
+// background thread.
+//
+// Encoded chunks stay in memory after they are written, up to
+// `memory_budget` bytes, so chunks that went out of view recently come
+// back without reading the disk. At a few hundred bytes per chunk this
+// holds far more chunks than the world keeps loaded. Chunks waiting to be
+// written always stay in memory.
+class RegionStore {
+public:
+    RegionStore() = default;
+
+    RegionStore(const RegionStore &) = delete;
+    RegionStore &operator=(const RegionStore &) = delete;
+
+    ~RegionStore();
+
+    // Keeps region files in `directory`, creating it if needed
+    bool open(const std::string &directory);
+
+    // Finishes the pending writes and closes the region files
+    void close();
+
+    bool is_open() const { return !directory.empty(); }
+
+    // Returns a new chunk read from disk, or nullptr if the chunk at
+    // `position` was never saved. Safe to call from several threads.
+    Chunk *load(const Point3 &position);
+
+    // Saves `chunk` to disk in the background
+    void save(const Chunk &chunk);
+
+    // Blocks until every saved chunk has been written
+    void flush();
+
+    // Bytes of encoded chunks kept in memory
+    size_t memory_usage();
+
+    // Written chunks are dropped from memory, oldest saved first, while
+    // more than this many bytes are in use
+    size_t memory_budget = 16 << 20;
+
+private:
+    struct Region {
+        Point2 position;
+        RegionFile *file;
+    };
+
+    struct Resident {
+        // Changes every time the chunk is saved again
+        uint64_t version;
+        // False until `data` is in the region file
+        bool written;
+        std::vector<uint8_t> data;
+    };
+
+    struct PositionHash {
+        size_t operator()(const Point3 &position) const;
+    };
+
+    struct Saved {
+        Point3 position;
+        uint64_t version;
+    };
+
+    std::string directory;
+
+    // Guards everything below but the writer
+    std::mutex mutex;
+    std::vector<Region> regions;
+    std::unordered_map<Point3, Resident, PositionHash> resident;
+    size_t resident_bytes = 0;
+    uint64_t next_version = 0;
+
+    // Every save in order, the versions since saved again are skipped
+    // when evicting
+    std::deque<Saved> saves;
+
+    // Single worker, so writes happen in the order they were saved
+    JobSystem writer;
+
+    // Returns the region file containing the chunk at `position`, opening
+    // it if needed. `mutex` must be held.
+    RegionFile *region(const Point3 &position);
+
+    void write_pending(const Point3 &position);
+
+    // Drops written chunks until within the budget. `mutex` must be held.
+    void evict();
+};
+
+#endif // REGION_H
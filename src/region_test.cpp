@@ -0,0 +1,267 @@
+#include "region.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <filesystem>
+
+#include "xmath.h"
+#include "chunk.h"
+#include "codec.h"
+#include "terrain.h"
+#include "world.h"
+
+static TerrainGenerator terrain{9};
+
+static std::string test_directory(const char *name) {
+    std::error_code error;
+    auto path = std::filesystem::temp_directory_path(error) / name;
+    std::filesystem::remove_all(path, error);
+    return path.string();
+}
+
+static bool same_voxels(const Chunk &a, const Chunk &b) {
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                if (a.get(x, y, z) != b.get(x, y, z)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void test_region_file() {
+    auto directory = test_directory("nocraft_region_file");
+    std::filesystem::create_directories(directory);
+    auto path = directory + "/r.0.0.ncr";
+
+    // Negative positions fall in the region at -1
+    auto *a = terrain.generate(Point3(-3, 0, -30));
+    auto *b = terrain.generate(Point3(-32, 0, -1));
+
+    std::vector<uint8_t> data_a, data_b;
+    encode_chunk(*a, Codec_RLE_LZ, &data_a);
+    encode_chunk(*b, Codec_RLE_LZ, &data_b);
+
+    {
+        RegionFile region;
+        assert(region.open(path));
+        assert(region.read(a->position) == nullptr);
+
+        assert(region.write(a->position, data_a.data(), data_a.size()));
+        assert(region.write(b->position, data_b.data(), data_b.size()));
+
+        auto *read = region.read(a->position);
+        assert(read != nullptr && read->saved && same_voxels(*a, *read));
+        unload_chunk(read);
+
+        // A bigger chunk no longer fits in place and moves to the end
+        for (int y = 100; y < 116; ++y) {
+            for (int x = 0; x < Chunk_SizeX; ++x) {
+                a->set(x, y, (x * 7 + y) % Chunk_SizeZ, Voxel(Voxel_Grass + (x + y) % 6));
+            }
+        }
+        data_a.clear();
+        encode_chunk(*a, Codec_RLE, &data_a);
+        assert(region.write(a->position, data_a.data(), data_a.size()));
+
+        read = region.read(a->position);
+        assert(read != nullptr && same_voxels(*a, *read));
+        unload_chunk(read);
+    }
+
+    // Everything is still there after reopening
+    {
+        RegionFile region;
+        assert(region.open(path));
+
+        auto *read_a = region.read(a->position);
+        auto *read_b = region.read(b->position);
+        assert(read_a != nullptr && same_voxels(*a, *read_a));
+        assert(read_b != nullptr && same_voxels(*b, *read_b));
+        unload_chunk(read_a);
+        unload_chunk(read_b);
+    }
+
+    // Chunks cut off by truncating the file are reported as corrupted,
+    // whether the file is truncated while open or before opening
+    {
+        RegionFile region;
+        assert(region.open(path));
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 64);
+        assert(region.read(a->position) == nullptr);
+    }
+    {
+        RegionFile region;
+        assert(region.open(path));
+        assert(region.read(a->position) == nullptr);
+        auto *read_b = region.read(b->position);
+        assert(read_b != nullptr && same_voxels(*b, *read_b));
+        unload_chunk(read_b);
+    }
+
+    // Anything else is not a region file
+    FILE *file = fopen(path.c_str(), "wb");
+    fputs("not a region", file);
+    fclose(file);
+    RegionFile region;
+    assert(!region.open(path));
+
+    unload_chunk(a);
+    unload_chunk(b);
+    std::filesystem::remove_all(directory);
+}
+
+void test_region_store() {
+    auto directory = test_directory("nocraft_region_store");
+
+    std::vector<Chunk *> chunks;
+    for (int x = -40; x <= 40; x += 8) {
+        chunks.push_back(terrain.generate(Point3(x, 0, -x / 2)));
+    }
+
+    {
+        RegionStore store;
+        assert(store.open(directory));
+        assert(store.load(chunks[0]->position) == nullptr);
+
+        // Readable right away, whether or not the write happened yet
+        for (auto *chunk : chunks) store.save(*chunk);
+        for (auto *chunk : chunks) {
+            auto *loaded = store.load(chunk->position);
+            assert(loaded != nullptr && same_voxels(*chunk, *loaded));
+            unload_chunk(loaded);
+        }
+
+        // Saving again replaces the chunk
+        chunks[3]->set(0, 200, 0, Voxel_Wood);
+        store.save(*chunks[3]);
+        store.flush();
+
+        auto *loaded = store.load(chunks[3]->position);
+        assert(loaded->get(0, 200, 0) == Voxel_Wood);
+        unload_chunk(loaded);
+
+        // Written chunks leave memory to stay within the budget, and are
+        // read from disk instead
+        assert(store.memory_usage() > 0);
+        store.memory_budget = store.memory_usage() / 2;
+        store.save(*chunks[5]);
+        store.flush();
+        assert(store.memory_usage() <= store.memory_budget);
+
+        for (auto *chunk : chunks) {
+            loaded = store.load(chunk->position);
+            assert(loaded != nullptr && same_voxels(*chunk, *loaded));
+            unload_chunk(loaded);
+        }
+    }
+
+    {
+        RegionStore store;
+        assert(store.open(directory));
+        for (auto *chunk : chunks) {
+            auto *loaded = store.load(chunk->position);
+            assert(loaded != nullptr && same_voxels(*chunk, *loaded));
+            unload_chunk(loaded);
+        }
+    }
+
+    for (auto *chunk : chunks) unload_chunk(chunk);
+    std::filesystem::remove_all(directory);
+}
+
+void test_world_teardown() {
+    auto directory = test_directory("nocraft_world_teardown");
+    auto position = Point3(2, 0, -3);
+    auto voxel = Point3(2 * Chunk_SizeX + 5, 200, -3 * Chunk_SizeZ + 7);
+
+    // An edited chunk that is never unloaded is saved when the world goes
+    {
+        World world{9};
+        assert(world.store.open(directory));
+        auto *chunk = world.terrain.generate(position);
+        chunk->saved = true;
+        world.chunks.insert(chunk);
+
+        assert(world.set_voxel(voxel, Voxel_Wood));
+        assert(!chunk->saved);
+    }
+
+    RegionStore store;
+    assert(store.open(directory));
+    auto *loaded = store.load(position);
+    assert(loaded != nullptr && loaded->get(5, 200, 7) == Voxel_Wood);
+    unload_chunk(loaded);
+
+    store.close();
+    std::filesystem::remove_all(directory);
+}
+
+template <typename F>
+static double time_ms(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Revisiting terrain, from disk or generated again
+void bench_region() {
+    constexpr int N = 8;
+    auto directory = test_directory("nocraft_region_bench");
+
+    RegionStore store;
+    store.open(directory);
+
+    TerrainGenerator generator{1};
+    size_t bytes = 0;
+    double generate = time_ms([&] {
+        for (int x = 0; x < N; ++x) {
+            for (int z = 0; z < N; ++z) {
+                auto *chunk = generator.generate(Point3(x, 0, z));
+                std::vector<uint8_t> data;
+                encode_chunk(*chunk, Codec_RLE_LZ, &data);
+                bytes += data.size();
+                store.save(*chunk);
+                unload_chunk(chunk);
+            }
+        }
+    });
+    store.flush();
+
+    auto load_all = [&] {
+        for (int x = 0; x < N; ++x) {
+            for (int z = 0; z < N; ++z) {
+                unload_chunk(store.load(Point3(x, 0, z)));
+            }
+        }
+    };
+
+    // Still in memory, then from the files once reopened
+    double memory = time_ms(load_all);
+    store.close();
+    store.open(directory);
+    double disk = time_ms(load_all);
+    store.close();
+
+    printf("[BENCH] generate    %8.1f us/chunk\n", generate * 1000.0 / (N * N));
+    printf("[BENCH] load memory %8.1f us/chunk\n", memory * 1000.0 / (N * N));
+    printf("[BENCH] load disk   %8.1f us/chunk %6zu bytes/chunk\n",
+           disk * 1000.0 / (N * N), bytes / (N * N));
+    std::filesystem::remove_all(directory);
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_region_file();
+    test_region_store();
+    test_world_teardown();
+
+    bench_region();
+}
+
+#endif
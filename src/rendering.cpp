@@ -3,23 +3,223 @@
 #include <glad/glad.h>
 #include <cstdio>
 #include <cstring>
+#include <vector>
 
 #include "xmath.h"
 #include "shader.h"
 #include "chunk.h"
 #include "camera.h"
 #include "world.h"
+#include "frustum.h"
+#include "range_allocator.h"
+
+// Initial size of the vertex arena, 4 MB. It doubles when full.
+constexpr uint32_t Arena_Vertices = 1 << 20;
+
+// Arena space is reserved in blocks of this many vertices, 16 quads, so
+// meshes can change a little and still be updated in place
+constexpr uint32_t Arena_Block = 64;
+
+// Binding point of the per frame uniform buffer
+constexpr GLuint Frame_Binding = 0;
+
+// The Frame uniform block of the shaders, in std140 layout. Matrices are
+// column major like Matrix4, so they are copied as they are.
+struct FrameUniforms {
+    Matrix4 view;
+    Matrix4 projection;
+};
+static_assert(sizeof(Matrix4) == 16 * sizeof(float), "Matrix4 must match the std140 mat4 layout");
+
+// Points the vertex attribute of the bound VAO at the bound array buffer
+static void set_vertex_format() {
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(PackedVertex), (void *)0);
+    glEnableVertexAttribArray(0);
+}
 
 void Renderer::gen_buffers() {
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     glEnable(GL_DEPTH_TEST);
+
+    glGenBuffers(1, &quad_index_buffer);
+
+    glGenVertexArrays(1, &chunk_vao);
+    glGenBuffers(1, &vertex_buffer);
+
+    glBindVertexArray(chunk_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, Arena_Vertices * sizeof(PackedVertex), nullptr, GL_DYNAMIC_DRAW);
+    set_vertex_format();
+
+    // The element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer);
+    glBindVertexArray(0);
+
+    vertex_ranges = RangeAllocator{Arena_Vertices};
+
+    // One ivec4 per block, alpha unused as buffer textures have no
+    // 3 component integer format in GL 3.3
+    glGenBuffers(1, &origin_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, origin_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, Arena_Vertices / Arena_Block * 4 * sizeof(int32_t),
+                 nullptr, GL_DYNAMIC_DRAW);
+
+    glGenTextures(1, &origin_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, origin_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, origin_buffer);
+
+    glGenBuffers(1, &frame_uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_uniforms);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, Frame_Binding, frame_uniforms);
 }
 
 void Renderer::load_shaders() {
     shaders[Shader::Unlit] =
         load_shader_program("assets/shaders/unlit.vs", "assets/shaders/unlit.fs");
+
+    // The palette never changes so it only needs to be uploaded once
+    auto &unlit = shaders[Shader::Unlit];
+    glUseProgram(unlit.id);
+    unlit.uniform("palette", Voxel_ColorMap, Voxel_Types);
+    unlit.uniform("chunk_origins", 0);
+    unlit.uniform("arena_block", int(Arena_Block));
+    unlit.bind_uniform_block("Frame", Frame_Binding);
+}
+
+void Renderer::reserve_quads(size_t quads) {
+    if (quads <= quad_capacity) return;
+
+    // Grow geometrically so only a few chunks ever trigger a resize
+    quad_capacity = math::max(quads, quad_capacity * 2);
+
+    std::vector<uint32_t> indices;
+    indices.reserve(quad_capacity * 6);
+
+    for (uint32_t i = 0; i < quad_capacity * 4; i += 4) {
+        indices.push_back(i + 0);
+        indices.push_back(i + 1);
+        indices.push_back(i + 2);
+        indices.push_back(i + 2);
+        indices.push_back(i + 3);
+        indices.push_back(i + 0);
+    }
+
+    // Resizing the storage keeps the buffer name, so the VAO that
+    // references the buffer stays valid.
+    glBindVertexArray(chunk_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+                 indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
 }
 
+void Renderer::grow_arena(uint32_t vertices) {
+    uint32_t old_capacity = vertex_ranges.capacity();
+    uint32_t new_capacity = math::max(old_capacity * 2, old_capacity + vertices);
+
+    // Copied on the GPU, the meshes never come back to the CPU
+    GLuint new_buffer;
+    glGenBuffers(1, &new_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(new_capacity) * sizeof(PackedVertex),
+                 nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, vertex_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        GLsizeiptr(old_capacity) * sizeof(PackedVertex));
+    glDeleteBuffers(1, &vertex_buffer);
+    vertex_buffer = new_buffer;
+
+    glBindVertexArray(chunk_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    set_vertex_format();
+    glBindVertexArray(0);
+
+    // The origins grow with the arena
+    constexpr size_t Block_Bytes = 4 * sizeof(int32_t);
+    GLuint new_origins;
+    glGenBuffers(1, &new_origins);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_origins);
+    glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(new_capacity / Arena_Block * Block_Bytes),
+                 nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, origin_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        GLsizeiptr(old_capacity / Arena_Block * Block_Bytes));
+    glDeleteBuffers(1, &origin_buffer);
+    origin_buffer = new_origins;
+
+    glBindTexture(GL_TEXTURE_BUFFER, origin_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, origin_buffer);
+
+    vertex_ranges.grow(new_capacity);
+}
+
+void Renderer::write_origin(const Chunk *chunk) {
+    auto origin = chunk->position * Point3(Chunk_SizeX, Chunk_SizeY, Chunk_SizeZ);
+
+    uint32_t n_blocks = chunk->vertex_capacity / Arena_Block;
+    origin_scratch.clear();
+    for (uint32_t i = 0; i < n_blocks; ++i) {
+        origin_scratch.insert(origin_scratch.end(), {origin.x, origin.y, origin.z, 0});
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, origin_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(chunk->vertex_offset / Arena_Block * 4 * sizeof(int32_t)),
+                    GLsizeiptr(origin_scratch.size() * sizeof(int32_t)), origin_scratch.data());
+}
+
+void Renderer::upload_chunk(Chunk *chunk) {
+    auto &mesh = chunk->mesh;
+    auto size = uint32_t(mesh.vertices.size());
+
+    if (size > chunk->vertex_capacity) {
+        release_chunk(chunk);
+
+        uint32_t capacity = (size + Arena_Block - 1) / Arena_Block * Arena_Block;
+        uint32_t offset = vertex_ranges.allocate(capacity);
+        if (offset == RangeAllocator::Invalid) {
+            grow_arena(capacity);
+            offset = vertex_ranges.allocate(capacity);
+        }
+        chunk->vertex_offset = offset;
+        chunk->vertex_capacity = capacity;
+        write_origin(chunk);
+    }
+    chunk->uploaded = true;
+
+    reserve_quads(mesh.quad_count());
+
+    if (size > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(chunk->vertex_offset) * sizeof(PackedVertex),
+                        GLsizeiptr(size) * sizeof(PackedVertex), mesh.vertices.data());
+    }
+}
+
+void Renderer::update_chunk(Chunk *chunk, uint32_t first, uint32_t end) {
+    auto &mesh = chunk->mesh;
+    if (!chunk->uploaded || mesh.vertices.size() > chunk->vertex_capacity) {
+        upload_chunk(chunk);
+        return;
+    }
+
+    reserve_quads(mesh.quad_count());
+
+    if (end > first) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(chunk->vertex_offset + first) * sizeof(PackedVertex),
+                        GLsizeiptr(end - first) * sizeof(PackedVertex), mesh.vertices.data() + first);
+    }
+}
+
+void Renderer::release_chunk(Chunk *chunk) {
+    if (chunk->vertex_capacity > 0) {
+        vertex_ranges.free(chunk->vertex_offset, chunk->vertex_capacity);
+    }
+    chunk->uploaded = false;
+    chunk->vertex_offset = 0;
+    chunk->vertex_capacity = 0;
+}
 
 void Renderer::draw(World *world) {
     auto &shader = shaders[Shader::Unlit];
@@ -30,25 +230,53 @@ void Renderer::draw(World *world) {
     glUseProgram(shader.id);
 
     // Transforms
-    auto view = world->camera.view_matrix();
-    auto projection = math::perspective(math::radians(60.0f), 800.f/600.f, 0.1f, 100.0f);
+    FrameUniforms frame;
+    frame.view = world->camera.view_matrix();
+    // Far enough for the most distant chunk in view
+    float far = float((world->view_distance + 1) * Chunk_SizeX) * 1.5f;
+    frame.projection = math::perspective(math::radians(60.0f), 800.f/600.f, 0.1f, far);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_uniforms);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
 
-    shader.uniform("view", view);
-    shader.uniform("projection", projection);
+    // Gather the bounds of every drawable chunk and cull them all at once
+    auto frustum = make_frustum(frame.projection * frame.view);
+    chunk_bounds.clear();
+    draw_list.clear();
 
-    // Render
     for (auto *chunk : world->chunks) {
-        glBindVertexArray(chunk->VAO);
+        // Not meshed yet, or nothing to draw
+        if (!chunk->uploaded || chunk->mesh.vertices.empty()) continue;
+
+        Vector3 min, max;
+        chunk->bounds(&min, &max);
+        chunk_bounds.push(min, max);
+        draw_list.push_back(chunk);
+    }
+
+    visible.resize(draw_list.size());
+    frustum_cull(frustum, chunk_bounds, visible.data());
 
-        auto model = Matrix4(1);
-        model = math::translate(model, chunk->world_position());
-        shader.uniform("model", model);
+    // Render, every visible chunk in one call
+    draw_counts.clear();
+    draw_indices.clear();
+    draw_base_vertices.clear();
+    for (size_t i = 0; i < draw_list.size(); ++i) {
+        if (!visible[i]) continue;
 
-        glBindBuffer(GL_ARRAY_BUFFER, chunk->VBO);
-        glDrawArrays(GL_TRIANGLES, 0, chunk->mesh.vertices.size());
+        auto *chunk = draw_list[i];
+        draw_counts.push_back(GLsizei(chunk->mesh.quad_count() * 6));
+        draw_indices.push_back(nullptr);
+        draw_base_vertices.push_back(GLint(chunk->vertex_offset));
     }
+    if (draw_counts.empty()) return;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, origin_texture);
 
-    //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-    //glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(chunk_vao);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, draw_counts.data(), GL_UNSIGNED_INT,
+                                  draw_indices.data(), GLsizei(draw_counts.size()),
+                                  draw_base_vertices.data());
+    glBindVertexArray(0);
 }
@@ -1,9 +1,14 @@
 #ifndef RENDERING_H
 #define RENDERING_H
 
+#include <vector>
+#include <cstdint>
+
 #include "shader.h"
+#include "frustum.h"
 #include "camera.h"
 #include "chunk.h"
+#include "range_allocator.h"
 
 class World;
 
@@ -16,10 +21,69 @@ public:
     void gen_buffers();
     void load_shaders();
 
+    // Writes the chunk mesh to the vertex arena, in place if it fits in
+    // the space the chunk already has. Must be called after the mesh is
+    // (re)built.
+    void upload_chunk(Chunk *chunk);
+
+    // Writes vertices [first, end) of the chunk mesh after it was patched
+    // in place, see World::set_voxel. Falls back to upload_chunk when the
+    // mesh outgrew the chunk's space.
+    void update_chunk(Chunk *chunk, uint32_t first, uint32_t end);
+
+    // Gives the chunk's space in the vertex arena back. Must be called
+    // before an uploaded chunk is unloaded.
+    void release_chunk(Chunk *chunk);
+
+    // Vertices of the arena in use by chunk meshes
+    const RangeAllocator &vertex_arena() const { return vertex_ranges; }
+
     void draw(World *world);
 
 private:
     Shader shaders[64];
+
+    // Index buffer with the triangles of consecutive quads, shared by
+    // all chunk meshes.
+    GLuint quad_index_buffer;
+    size_t quad_capacity = 0;
+
+    // Every chunk mesh lives in one vertex buffer, drawn through a single
+    // VAO with the chunk's offset as base vertex. Uploads only write the
+    // chunk's range and drawing never switches buffers.
+    GLuint chunk_vao = 0;
+    GLuint vertex_buffer = 0;
+    RangeAllocator vertex_ranges;
+
+    // World space origin of the chunk owning each Arena_Block vertices
+    // of the arena, read by the vertex shader through a buffer texture.
+    // The shader places every chunk without a per chunk uniform, so all
+    // visible chunks are drawn with a single multi draw call.
+    GLuint origin_buffer = 0;
+    GLuint origin_texture = 0;
+    std::vector<int32_t> origin_scratch;
+
+    // Uniform buffer with the per frame data shared by every shader, see
+    // FrameUniforms. Written once per frame with a single update.
+    GLuint frame_uniforms = 0;
+
+    // Multi draw arguments, rebuilt every frame
+    std::vector<GLsizei> draw_counts;
+    std::vector<const void *> draw_indices;
+    std::vector<GLint> draw_base_vertices;
+
+    // Per frame scratch for frustum culling
+    BoundsSoA chunk_bounds;
+    std::vector<Chunk *> draw_list;
+    std::vector<uint8_t> visible;
+
+    void reserve_quads(size_t quads);
+
+    // Moves the arena to a bigger buffer with room for `vertices` more
+    void grow_arena(uint32_t vertices);
+
+    // Records the chunk as the owner of its range for the shader
+    void write_origin(const Chunk *chunk);
 };
 
 #endif // RENDERING_H
@@ -63,9 +63,50 @@ Shader load_shader_program(const std::string &vert_name, const std::string &frag
 
     glDeleteShader(vert.value());
     glDeleteShader(frag.value());
-    return Shader{id};
+
+    Shader shader{id};
+    shader.cache_uniforms();
+    return shader;
 }
 
-GLuint Shader::uniform_location(const char *name) const {
-    return glGetUniformLocation(id, name);
+void Shader::cache_uniforms() {
+    uniforms.clear();
+
+    int count = 0, max_length = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::string name(size_t(max_length), '\0');
+    for (int i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(id, GLuint(i), max_length, &length, &size, &type, &name[0]);
+
+        // Arrays are reported as "name[0]" but set by their plain name
+        std::string plain = name.substr(0, size_t(length));
+        if (plain.size() > 3 && plain.compare(plain.size() - 3, 3, "[0]") == 0) {
+            plain.resize(plain.size() - 3);
+        }
+
+        // Uniforms in blocks have no location
+        GLint location = glGetUniformLocation(id, plain.c_str());
+        if (location != -1) uniforms.push_back({plain, location});
+    }
+}
+
+GLint Shader::uniform_location(const char *name) const {
+    for (const auto &entry : uniforms) {
+        if (entry.name == name) return entry.location;
+    }
+    return -1;
+}
+
+void Shader::bind_uniform_block(const char *name, GLuint binding) const {
+    GLuint index = glGetUniformBlockIndex(id, name);
+    if (index == GL_INVALID_INDEX) {
+        printf("[SHADER] error: no uniform block %s\n", name);
+        return;
+    }
+    glUniformBlockBinding(id, index, binding);
 }
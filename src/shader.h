@@ -2,10 +2,17 @@
 #define SHADER_H
 
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 
 #include "xmath.h"
 
+// Location of a uniform, resolved once with Shader::find_uniform so
+// setting it skips the name lookup
+struct Uniform {
+    GLint location = -1;
+};
+
 struct Shader {
     enum Type {
         Unlit,
@@ -16,40 +23,104 @@ struct Shader {
     Shader() = default;
     Shader(GLuint program) : id{ program } {}
 
-    GLuint uniform_location(const char* name) const;
+    // Looks the uniform up in the locations cached when the program was
+    // linked. Missing uniforms get -1, which GL ignores.
+    GLint uniform_location(const char* name) const;
+    Uniform find_uniform(const char *name) const { return {uniform_location(name)}; }
+
+    // Reads the locations of every active uniform of the program, done
+    // by load_shader_program after linking
+    void cache_uniforms();
+
+    // Makes the uniform block `name` read from the buffer bound to
+    // `binding` with glBindBufferBase
+    void bind_uniform_block(const char *name, GLuint binding) const;
 
+    void uniform(Uniform u, float value) const;
+    void uniform(Uniform u, int value) const;
+    void uniform(Uniform u, const Vector2 &value) const;
+    void uniform(Uniform u, const Vector3 &value) const;
+    void uniform(Uniform u, const Vector4 &value) const;
+    void uniform(Uniform u, const Matrix4 &value) const;
+    void uniform(Uniform u, const Vector4 *values, int count) const;
+
+    // Same as above, by name
     void uniform(const char *name, float value) const;
     void uniform(const char *name, int value) const;
     void uniform(const char *name, const Vector2 &value) const;
     void uniform(const char *name, const Vector3 &value) const;
     void uniform(const char *name, const Vector4 &value) const;
     void uniform(const char *name, const Matrix4 &value) const;
+
+    // Sets a uniform array of `count` elements
+    void uniform(const char *name, const Vector4 *values, int count) const;
+
+private:
+    struct UniformEntry {
+        std::string name;
+        GLint location;
+    };
+
+    // Active uniforms of the program, a handful per shader
+    std::vector<UniformEntry> uniforms;
 };
 
 Shader load_shader_program(const std::string &vert_name, const std::string &frag_name);
 
+inline void Shader::uniform(Uniform u, float value) const {
+    glUniform1f(u.location, value);
+}
+
+inline void Shader::uniform(Uniform u, int value) const {
+    glUniform1i(u.location, value);
+}
+
+inline void Shader::uniform(Uniform u, const Vector2 &v) const {
+    glUniform2fv(u.location, 1, reinterpret_cast<const float *>(&v));
+}
+
+inline void Shader::uniform(Uniform u, const Vector3 &v) const {
+    glUniform3fv(u.location, 1, reinterpret_cast<const float *>(&v));
+}
+
+inline void Shader::uniform(Uniform u, const Vector4 &v) const {
+    glUniform4fv(u.location, 1, reinterpret_cast<const float *>(&v));
+}
+
+inline void Shader::uniform(Uniform u, const Matrix4 &m) const {
+    glUniformMatrix4fv(u.location, 1, GL_FALSE, reinterpret_cast<const float *>(&m));
+}
+
+inline void Shader::uniform(Uniform u, const Vector4 *v, int count) const {
+    glUniform4fv(u.location, count, reinterpret_cast<const float *>(v));
+}
+
 inline void Shader::uniform(const char *name, float value) const {
-    glUniform1f(uniform_location(name), value);
+    uniform(find_uniform(name), value);
 }
 
 inline void Shader::uniform(const char *name, int value) const {
-    glUniform1i(uniform_location(name), value);
+    uniform(find_uniform(name), value);
 }
 
 inline void Shader::uniform(const char *name, const Vector2 &v) const {
-    glUniform2fv(uniform_location(name), 1, reinterpret_cast<const float *>(&v));
+    uniform(find_uniform(name), v);
 }
 
 inline void Shader::uniform(const char *name, const Vector3 &v) const {
-    glUniform3fv(uniform_location(name), 1, reinterpret_cast<const float *>(&v));
+    uniform(find_uniform(name), v);
 }
 
 inline void Shader::uniform(const char *name, const Vector4 &v) const {
-    glUniform4fv(uniform_location(name), 1, reinterpret_cast<const float *>(&v));
+    uniform(find_uniform(name), v);
 }
 
 inline void Shader::uniform(const char *name, const Matrix4 &m) const {
-    glUniformMatrix4fv(uniform_location(name), 1, GL_FALSE, reinterpret_cast<const float *>(&m));
+    uniform(find_uniform(name), m);
+}
+
+inline void Shader::uniform(const char *name, const Vector4 *v, int count) const {
+    uniform(find_uniform(name), v, count);
 }
 
 #endif // SHADER_H
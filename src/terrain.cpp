@@ -0,0 +1,357 @@
+#include "terrain.h"
+
+#include <mutex>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+
+#include "xmath.h"
+#include "random.h"
+#include "chunk.h"
+
+// Ground more than this many voxels higher or lower than a neighboring
+// column is too steep for soil
+constexpr int Steep_Slope = 3;
+
+// Depth of the grass, dirt or sand over the stone
+constexpr int Soil_Depth = 4;
+
+// Caves stay at least this many voxels below the surface
+constexpr int Cave_Roof = 6;
+
+// Caves are sampled every Cave_Step voxels and interpolated in between
+constexpr int Cave_Step = 4;
+constexpr float Cave_Scale = 40.0f;
+constexpr float Cave_Threshold = 0.45f;
+
+// On average one column in Tree_Chance grows a tree
+constexpr int Tree_Chance = 90;
+constexpr int Leaf_Radius = 2;
+
+// Columns of the neighbors needed around the chunk, for the slopes of
+// the columns trees can grow in
+constexpr int Border = Leaf_Radius + 1;
+
+HeightmapCache::HeightmapCache(size_t capacity) {
+    if (capacity == 0) return;
+
+    size_t size = Ways;
+    while (size < capacity) size *= 2;
+    slots.resize(size, Slot{Heightmap{}, 0});
+}
+
+// First slot of the set `position` belongs to
+static size_t cache_set(const Point2 &position, size_t n_sets, size_t ways) {
+    uint64_t key = uint64_t(uint32_t(position.x)) << 32 | uint32_t(position.y);
+    return (size_t(SplitMix64{key}.nexti64()) & (n_sets - 1)) * ways;
+}
+
+bool HeightmapCache::find(const Point2 &position, Heightmap *out) {
+    std::lock_guard<std::mutex> lock{mutex};
+
+    if (!slots.empty()) {
+        size_t set = cache_set(position, slots.size() / Ways, Ways);
+        for (size_t i = set; i < set + Ways; ++i) {
+            const auto &slot = slots[i];
+            if (slot.stamp != 0 && slot.heightmap.position == position) {
+                *out = slot.heightmap;
+                ++n_hits;
+                return true;
+            }
+        }
+    }
+    ++n_misses;
+    return false;
+}
+
+void HeightmapCache::insert(const Heightmap &heightmap) {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (slots.empty()) return;
+
+    // Reuse the slot if another thread inserted the same heightmap,
+    // otherwise take the oldest slot. Empty slots are the oldest.
+    size_t set = cache_set(heightmap.position, slots.size() / Ways, Ways);
+    size_t target = set;
+    for (size_t i = set; i < set + Ways; ++i) {
+        const auto &slot = slots[i];
+        if (slot.stamp != 0 && slot.heightmap.position == heightmap.position) {
+            target = i;
+            break;
+        }
+        if (slot.stamp < slots[target].stamp) target = i;
+    }
+
+    slots[target].heightmap = heightmap;
+    slots[target].stamp = ++clock;
+}
+
+size_t HeightmapCache::hits() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return n_hits;
+}
+
+size_t HeightmapCache::misses() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return n_misses;
+}
+
+// Different seeds per stage so caves do not follow the hills
+TerrainGenerator::TerrainGenerator(uint64_t seed, size_t cache_capacity)
+    : terrain_seed{seed},
+      height_noise{seed},
+      cave_noise{SplitMix64{seed}.nexti64()},
+      cache{cache_capacity} {}
+
+constexpr int Columns = Chunk_SizeX * Chunk_SizeZ;
+
+// Fractal noise over the columns of a chunk, out[x * Chunk_SizeZ + z]
+// being the noise of column (x, z). Octaves double in frequency and halve
+// in amplitude and are sampled one whole chunk at a time with snoise_grid.
+// The sums are the same as snoise_fractal, or snoise_fractal_b if
+// `billow` is set.
+static void fractal_columns(const NoiseGenerator &noise, const Vector2 &origin, float frequency,
+                            int octaves, bool billow, float (&out)[Columns]) {
+    float octave[Columns];
+    float amp = 1.0f;
+    float range = 0.0f;
+
+    for (int n = 0; n < Columns; ++n) out[n] = 0.0f;
+
+    for (int i = 0; i < octaves; ++i) {
+        noise.snoise_grid(origin, frequency, Chunk_SizeX, Chunk_SizeZ, octave);
+        for (int n = 0; n < Columns; ++n) {
+            float v = billow ? fabsf(octave[n]) * 2.0f - 1.0f : octave[n];
+            out[n] += v * amp;
+        }
+        range += amp;
+        amp *= 0.5f;
+        frequency *= 2.0f;
+    }
+
+    for (int n = 0; n < Columns; ++n) out[n] /= range;
+}
+
+void TerrainGenerator::compute_heightmap(const Point2 &position, Heightmap *out) const {
+    out->position = position;
+
+    auto origin = Vector2(float(position.x * Chunk_SizeX), float(position.y * Chunk_SizeZ));
+
+    float hills[Columns];
+    fractal_columns(height_noise, origin, 1.0f / 256.0f, 4, false, hills);
+
+    // Billow noise has sharp valleys, flipped they become ridges. The
+    // ridges are offset by 100 in noise space, 19200 columns.
+    float ridges[Columns];
+    fractal_columns(height_noise, origin + Vector2(100.0f * 192.0f), 1.0f / 192.0f, 4, true, ridges);
+
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            int n = x * Chunk_SizeZ + z;
+
+            // Mountains only rise where the hills are already high
+            float mountains = math::saturate((hills[n] - 0.1f) * 2.5f);
+
+            float height = 40.0f + hills[n] * 16.0f + mountains * (1.0f - ridges[n]) * 40.0f;
+
+            // Leave room for trees at the top of the chunk
+            out->height[x][z] = uint8_t(math::clamp(int(height), 1, Chunk_SizeY - 16));
+        }
+    }
+}
+
+void TerrainGenerator::heightmap(const Point2 &position, Heightmap *out) {
+    if (cache.find(position, out)) return;
+
+    compute_heightmap(position, out);
+    cache.insert(*out);
+}
+
+// Random bits for the world column (x, z)
+static uint64_t column_hash(uint64_t seed, int x, int z) {
+    uint64_t key = uint64_t(uint32_t(x)) << 32 | uint32_t(z);
+    return SplitMix64{key ^ SplitMix64{seed}.nexti64()}.nexti64();
+}
+
+Chunk *TerrainGenerator::generate(const Point3 &position) {
+    auto *chunk = alloc_chunk(position);
+    auto world_pos = chunk->world_position();
+
+    //
+    // Heightmap
+    //
+
+    Heightmap maps[3][3];
+    for (int dx = 0; dx < 3; ++dx) {
+        for (int dz = 0; dz < 3; ++dz) {
+            heightmap(Point2(position.x + dx - 1, position.z + dz - 1), &maps[dx][dz]);
+        }
+    }
+
+    // Heights of the chunk columns and of the Border columns around them
+    constexpr int Size = Chunk_SizeX + 2 * Border;
+    static_assert(Chunk_SizeX == Chunk_SizeZ, "Heights assume a square chunk base");
+
+    int heights[Size][Size];
+    for (int i = 0; i < Size; ++i) {
+        for (int j = 0; j < Size; ++j) {
+            int x = i - Border + Chunk_SizeX;
+            int z = j - Border + Chunk_SizeZ;
+            const auto &map = maps[x / Chunk_SizeX][z / Chunk_SizeZ];
+            heights[i][j] = map.height[x % Chunk_SizeX][z % Chunk_SizeZ];
+        }
+    }
+
+    // Column coordinates are relative to the chunk, -Border to
+    // Chunk_SizeX + Border - 1
+    auto height = [&](int x, int z) { return heights[x + Border][z + Border]; };
+
+    auto steep = [&](int x, int z) {
+        int h = height(x, z);
+        return abs(h - height(x - 1, z)) > Steep_Slope || abs(h - height(x + 1, z)) > Steep_Slope
+            || abs(h - height(x, z - 1)) > Steep_Slope || abs(h - height(x, z + 1)) > Steep_Slope;
+    };
+
+    auto beach = [&](int x, int z) { return height(x, z) <= sea_level + 1; };
+
+    int ground_top = 0;
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int z = 0; z < Chunk_SizeZ; ++z) {
+            ground_top = math::max(ground_top, height(x, z));
+        }
+    }
+
+    //
+    // Caves
+    //
+
+    constexpr int Cave_NX = Chunk_SizeX / Cave_Step + 1;
+    constexpr int Cave_NZ = Chunk_SizeZ / Cave_Step + 1;
+    constexpr int Cave_MaxY = Chunk_SizeY / Cave_Step + 1;
+
+    // The lattice only needs to reach the highest cave
+    int cave_top = math::max(ground_top - Cave_Roof, 0);
+    int cave_ny = cave_top / Cave_Step + 2;
+    assert(cave_ny <= Cave_MaxY);
+
+    float density[Cave_NX * Cave_MaxY * Cave_NZ];
+    auto cave_origin = Vector3(world_pos.x / Cave_Step, 0.0f, world_pos.z / Cave_Step);
+    cave_noise.snoise_grid(cave_origin, Cave_Step / Cave_Scale,
+                           Cave_NX, cave_ny, Cave_NZ, density);
+
+    auto cave = [&](int x, int y, int z) {
+        int i = x / Cave_Step, j = y / Cave_Step, k = z / Cave_Step;
+        float fx = float(x % Cave_Step) / Cave_Step;
+        float fy = float(y % Cave_Step) / Cave_Step;
+        float fz = float(z % Cave_Step) / Cave_Step;
+
+        auto d = [&](int di, int dj, int dk) {
+            return density[((i + di) * cave_ny + (j + dj)) * Cave_NZ + (k + dk)];
+        };
+        float d00 = math::lerp(d(0, 0, 0), d(1, 0, 0), fx);
+        float d01 = math::lerp(d(0, 0, 1), d(1, 0, 1), fx);
+        float d10 = math::lerp(d(0, 1, 0), d(1, 1, 0), fx);
+        float d11 = math::lerp(d(0, 1, 1), d(1, 1, 1), fx);
+        float d0 = math::lerp(d00, d10, fy);
+        float d1 = math::lerp(d01, d11, fy);
+        return math::lerp(d0, d1, fz) > Cave_Threshold;
+    };
+
+    //
+    // Decorations
+    //
+
+    struct Tree {
+        int x, z;
+        int base;
+        int trunk;
+    };
+    static thread_local std::vector<Tree> trees;
+    trees.clear();
+
+    // Trees in the neighbors may reach into the chunk
+    int top = ground_top;
+    for (int x = -Leaf_Radius; x < Chunk_SizeX + Leaf_Radius; ++x) {
+        for (int z = -Leaf_Radius; z < Chunk_SizeZ + Leaf_Radius; ++z) {
+            uint64_t hash = column_hash(terrain_seed, int(world_pos.x) + x, int(world_pos.z) + z);
+            if (hash % Tree_Chance != 0) continue;
+            if (beach(x, z) || steep(x, z)) continue;
+
+            Tree tree{x, z, height(x, z), 4 + int((hash >> 32) % 3)};
+            trees.push_back(tree);
+            top = math::max(top, tree.base + tree.trunk + 2);
+        }
+    }
+
+    //
+    // Surface, one section at a time
+    //
+
+    Voxel voxels[Section_Volume];
+    int n_sections = math::min((top + Section_Size - 1) / Section_Size, Chunk_Sections);
+
+    for (int s = 0; s < n_sections; ++s) {
+        int base_y = s * Section_Size;
+
+        for (int x = 0; x < Chunk_SizeX; ++x) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                int h = height(x, z);
+                bool rock = steep(x, z);
+                bool sand = beach(x, z);
+
+                for (int y = 0; y < Section_Size; ++y) {
+                    int wy = base_y + y;
+                    auto &voxel = voxels[(x * Section_Size + y) * Section_Size + z];
+
+                    int depth = h - 1 - wy;
+                    if (depth < 0) {
+                        voxel = Voxel_Air;
+                    } else if (wy > 0 && depth >= Cave_Roof && cave(x, wy, z)) {
+                        voxel = Voxel_Air;
+                    } else if (rock || depth >= Soil_Depth) {
+                        voxel = Voxel_Stone;
+                    } else if (sand) {
+                        voxel = Voxel_Sand;
+                    } else {
+                        voxel = depth == 0 ? Voxel_Grass : Voxel_Dirt;
+                    }
+                }
+            }
+        }
+
+        // Writes a tree voxel if it falls inside the section
+        auto place = [&](int x, int y, int z, Voxel voxel) {
+            y -= base_y;
+            if (x < 0 || x >= Chunk_SizeX || z < 0 || z >= Chunk_SizeZ) return;
+            if (y < 0 || y >= Section_Size) return;
+
+            auto &dst = voxels[(x * Section_Size + y) * Section_Size + z];
+            // Leaves do not replace the ground or other trees
+            if (voxel != Voxel_Leaves || dst == Voxel_Air) dst = voxel;
+        };
+
+        for (const auto &tree : trees) {
+            int crown = tree.base + tree.trunk;
+            if (crown + 2 <= base_y || tree.base >= base_y + Section_Size) continue;
+
+            // Two wide layers around the top of the trunk and two narrow
+            // layers above
+            for (int dy = -2; dy <= 1; ++dy) {
+                int r = dy < 0 ? Leaf_Radius : 1;
+                for (int dx = -r; dx <= r; ++dx) {
+                    for (int dz = -r; dz <= r; ++dz) {
+                        if (abs(dx) == r && abs(dz) == r && (r == Leaf_Radius || dy == 1)) continue;
+                        place(tree.x + dx, crown + dy, tree.z + dz, Voxel_Leaves);
+                    }
+                }
+            }
+
+            for (int y = tree.base; y < crown; ++y) {
+                place(tree.x, y, tree.z, Voxel_Wood);
+            }
+        }
+
+        chunk->sections[s].assign(voxels);
+    }
+
+    return chunk;
+}
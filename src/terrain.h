@@ -0,0 +1,100 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "xmath.h"
+#include "random.h"
+#include "voxel.h"
+#include "chunk.h"
+
+// Surface heights of a chunk column, the first stage of terrain
+// generation. Chunks read the heightmaps of their neighbors as well as
+// their own, for slopes and for trees growing across the border.
+struct Heightmap {
+    // Chunk position in the XZ plane
+    Point2 position;
+
+    // Height of the first air voxel above the ground, indexed [x][z]
+    uint8_t height[Chunk_SizeX][Chunk_SizeZ];
+};
+
+// Recently computed heightmaps. The cache is 4 way set associative, a
+// heightmap replaces the oldest heightmap of its set when the set is
+// full. Heightmaps are copied in and out under a lock so it is safe to
+// use from several threads.
+class HeightmapCache {
+public:
+    // `capacity` is rounded up to a power of two, 0 disables the cache
+    explicit HeightmapCache(size_t capacity);
+
+    // Copies the heightmap at `position` to `out` if it is cached
+    bool find(const Point2 &position, Heightmap *out);
+
+    void insert(const Heightmap &heightmap);
+
+    size_t hits();
+    size_t misses();
+
+private:
+    static constexpr size_t Ways = 4;
+
+    struct Slot {
+        Heightmap heightmap;
+        // 0 if the slot is empty, otherwise when it was filled
+        uint64_t stamp;
+    };
+
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    uint64_t clock = 0;
+    size_t n_hits = 0;
+    size_t n_misses = 0;
+};
+
+// Generates chunks in stages:
+//   1. Heightmap: rolling hills from fractal noise, raised into ridged
+//      mountains by billow noise where the hills are high.
+//   2. Caves: 3D noise sampled on a coarse lattice and interpolated,
+//      carved out below the surface.
+//   3. Surface: grass on dirt, sand along the shore and bare stone on
+//      steep slopes.
+//   4. Decorations: trees, which may reach into the neighboring chunks.
+// Every chunk needs the heightmaps of its 8 neighbors, so heightmaps are
+// cached and each is usually computed once for all the chunks around it.
+// Sections are filled whole and sections above the terrain are skipped.
+// generate() may be called from several threads at once.
+class TerrainGenerator {
+public:
+    // Ground at or below this height is a beach
+    int sea_level = 36;
+
+    explicit TerrainGenerator(uint64_t seed = 0, size_t cache_capacity = 1024);
+
+    TerrainGenerator(const TerrainGenerator &) = delete;
+    TerrainGenerator &operator=(const TerrainGenerator &) = delete;
+
+    uint64_t seed() const { return terrain_seed; }
+
+    // Generates the voxels of the chunk at `position`. Does not touch
+    // OpenGL so it can run on a worker thread. The mesh is built
+    // separately since it depends on the neighboring chunks.
+    Chunk *generate(const Point3 &position);
+
+    // Heightmap of the chunk column at `position`, cached if possible
+    void heightmap(const Point2 &position, Heightmap *out);
+
+    HeightmapCache &heightmap_cache() { return cache; }
+
+private:
+    uint64_t terrain_seed;
+    NoiseGenerator height_noise;
+    NoiseGenerator cave_noise;
+    HeightmapCache cache;
+
+    void compute_heightmap(const Point2 &position, Heightmap *out) const;
+};
+
+#endif // TERRAIN_H
@@ -0,0 +1,126 @@
+#include "terrain.h"
+
+#include <cstdio>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "xmath.h"
+#include "chunk.h"
+
+static bool same_voxels(const Chunk &a, const Chunk &b) {
+    for (int x = 0; x < Chunk_SizeX; ++x) {
+        for (int y = 0; y < Chunk_SizeY; ++y) {
+            for (int z = 0; z < Chunk_SizeZ; ++z) {
+                if (a.get(x, y, z) != b.get(x, y, z)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void test_terrain_seed() {
+    TerrainGenerator a{11};
+    TerrainGenerator b{11};
+    TerrainGenerator c{12};
+
+    auto *chunk_a = a.generate(Point3(2, 0, -3));
+    auto *chunk_b = b.generate(Point3(2, 0, -3));
+    auto *chunk_c = c.generate(Point3(2, 0, -3));
+    assert(same_voxels(*chunk_a, *chunk_b));
+    assert(!same_voxels(*chunk_a, *chunk_c));
+
+    unload_chunk(chunk_a);
+    unload_chunk(chunk_b);
+    unload_chunk(chunk_c);
+}
+
+void test_terrain_cache() {
+    TerrainGenerator cached{5};
+    TerrainGenerator uncached{5, 0};
+
+    // Chunks next to each other share most of their heightmaps
+    for (int x = -2; x <= 2; ++x) {
+        for (int z = -2; z <= 2; ++z) {
+            auto *a = cached.generate(Point3(x, 0, z));
+            auto *b = uncached.generate(Point3(x, 0, z));
+            assert(same_voxels(*a, *b));
+            unload_chunk(a);
+            unload_chunk(b);
+        }
+    }
+
+    // 7x7 columns are needed for 5x5 chunks
+    auto &cache = cached.heightmap_cache();
+    assert(cache.misses() == 7 * 7);
+    assert(cache.hits() == 5 * 5 * 9 - 7 * 7);
+    assert(uncached.heightmap_cache().hits() == 0);
+}
+
+void test_terrain_layers() {
+    TerrainGenerator terrain{3};
+
+    int surface_types[Voxel_Types] = {};
+    int trees = 0;
+
+    for (int cx = 0; cx < 4; ++cx) {
+        for (int cz = 0; cz < 4; ++cz) {
+            auto *chunk = terrain.generate(Point3(cx, 0, cz));
+            Heightmap heightmap;
+            terrain.heightmap(Point2(cx, cz), &heightmap);
+
+            for (int x = 0; x < Chunk_SizeX; ++x) {
+                for (int z = 0; z < Chunk_SizeZ; ++z) {
+                    int h = heightmap.height[x][z];
+                    auto surface = chunk->get(x, h - 1, z);
+                    surface_types[surface]++;
+
+                    // Caves stay under the surface, trees grow on it
+                    assert(surface != Voxel_Air);
+                    auto above = chunk->get(x, h, z);
+                    assert(above == Voxel_Air || above == Voxel_Wood || above == Voxel_Leaves);
+                    trees += above == Voxel_Wood;
+                }
+            }
+            unload_chunk(chunk);
+        }
+    }
+
+    assert(surface_types[Voxel_Grass] > 0);
+    assert(trees > 0);
+}
+
+template <typename F>
+static double time_ms(F &&f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void bench_terrain(size_t cache_capacity, const char *name) {
+    constexpr int N = 8;
+    TerrainGenerator terrain{1, cache_capacity};
+
+    double ms = time_ms([&] {
+        for (int x = 0; x < N; ++x) {
+            for (int z = 0; z < N; ++z) {
+                unload_chunk(terrain.generate(Point3(x, 0, z)));
+            }
+        }
+    });
+    printf("[BENCH] %-10s %8.1f us/chunk\n", name, ms * 1000.0 / (N * N));
+}
+
+#ifdef TEST
+
+int main(int, char *[]) {
+    test_terrain_seed();
+    test_terrain_cache();
+    test_terrain_layers();
+
+    bench_terrain(1024, "cached");
+    bench_terrain(0, "uncached");
+}
+
+#endif
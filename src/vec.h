@@ -109,7 +109,7 @@ MATH_VEC2_OP(/)
 
 template <typename T>
 bool operator==(const Vector<2, T> &a, const Vector<2, T> &b) {
-    return a.x == b.x && a.y == a.y;
+    return a.x == b.x && a.y == b.y;
 }
 
 template <typename T>
@@ -162,7 +162,7 @@ MATH_VEC3_OP(/)
 
 template <typename T>
 bool operator==(const Vector<3, T> &a, const Vector<3, T> &b) {
-    return a.x == b.x && a.y == a.y && a.z == b.z;
+    return a.x == b.x && a.y == b.y && a.z == b.z;
 }
 
 template <typename T>
@@ -221,7 +221,7 @@ MATH_VEC4_OP(/)
 
 template <typename T>
 bool operator==(const Vector<4, T> &a, const Vector<4, T> &b) {
-    return a.x == b.x && a.y == a.y && a.z == b.z && a.w == b.w;
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
 }
 
 template <typename T>
@@ -0,0 +1,55 @@
+#ifndef VOXEL_H
+#define VOXEL_H
+
+#include <cstdint>
+
+#include "xmath.h"
+
+enum Voxel : uint8_t {
+    Voxel_Air,
+    Voxel_Grass,
+    Voxel_Stone,
+    Voxel_Dirt,
+    Voxel_Sand,
+    Voxel_Wood,
+    Voxel_Leaves,
+};
+
+constexpr int Voxel_Types = 7;
+
+constexpr int Chunk_SizeX = 16;
+constexpr int Chunk_SizeY = 256;
+constexpr int Chunk_SizeZ = 16;
+
+constexpr Vector4 Voxel_ColorMap[Voxel_Types] = {
+    {0.00f, 0.00f, 0.00f, 0.00f},
+    {0.22f, 0.54f, 0.18f, 1.00f},
+    {0.53f, 0.53f, 0.53f, 1.00f},
+    {0.45f, 0.32f, 0.20f, 1.00f},
+    {0.86f, 0.80f, 0.55f, 1.00f},
+    {0.40f, 0.27f, 0.13f, 1.00f},
+    {0.16f, 0.42f, 0.12f, 1.00f},
+};
+
+// Dense voxels of a single chunk, indexed [x][y][z]
+using VoxelArray = Voxel[Chunk_SizeX][Chunk_SizeY][Chunk_SizeZ];
+
+// Chunks are split vertically into cubic sections
+constexpr int Section_Size = 16;
+constexpr int Chunk_Sections = Chunk_SizeY / Section_Size;
+constexpr int Section_Volume = Section_Size * Section_Size * Section_Size;
+
+static_assert(Chunk_SizeX == Section_Size && Chunk_SizeZ == Section_Size,
+              "Sections span the whole chunk base");
+
+// What a section is made of, used to skip work on uniform sections
+enum SectionKind : uint8_t {
+    // Any mix of voxels
+    Section_Mixed,
+    // Only air
+    Section_Air,
+    // No air, but possibly several types of solid voxels
+    Section_Solid,
+};
+
+#endif // VOXEL_H
@@ -1,18 +1,387 @@
 #include "world.h"
 
 #include <vector>
+#include <cstdio>
+#include <mutex>
+#include <algorithm>
 
 #include "rendering.h"
 #include "chunk.h"
+#include "mesher.h"
 #include "xmath.h"
 
+// Horizontal neighbors of a chunk and the side of the chunk they touch
+static const struct {
+    Point3 offset;
+    Face side;
+} Chunk_Neighbors[] = {
+    {{ 1, 0,  0}, Face_PosX},
+    {{-1, 0,  0}, Face_NegX},
+    {{ 0, 0,  1}, Face_PosZ},
+    {{ 0, 0, -1}, Face_NegZ},
+};
+
+World::~World() {
+    // Workers may still be pushing results
+    jobs.stop();
+
+    for (auto *chunk : chunks) unload(chunk);
+    for (auto *chunk : generated) unload(chunk);
+    chunks.clear();
+
+    for (auto &result : meshed) mesh_pool.release(result.mesh);
+    for (auto &result : ready) mesh_pool.release(result.mesh);
+
+    // Waits for the last chunks to be written
+    store.close();
+}
+
 void World::load() {
     renderer.gen_buffers();
     renderer.load_shaders();
 
-    for (int x = -6; x <= 6; ++x) {
-        for (int z = -6; z <= 6; ++z) {
-            chunks.push_back(load_chunk(Point3{x, 0, z}));
+    if (!store.open(save_directory)) {
+        fprintf(stderr, "World: Chunks will not be saved\n");
+    }
+    jobs.start();
+}
+
+void World::unload(Chunk *chunk) {
+    if (!chunk->saved) store.save(*chunk);
+    renderer.release_chunk(chunk);
+    unload_chunk(chunk);
+}
+
+bool World::in_view(const Point3 &position, int distance) const {
+    int dx = position.x - center.x;
+    int dz = position.z - center.z;
+    return dx * dx + dz * dz <= distance * distance;
+}
+
+int World::lod_level(const Point3 &position) const {
+    int lod = 0;
+    while (lod < Lod_Levels - 1 && !in_view(position, lod_distance[lod])) ++lod;
+    return lod;
+}
+
+static bool contains(const std::vector<Point3> &positions, const Point3 &position) {
+    return std::find(positions.begin(), positions.end(), position) != positions.end();
+}
+
+static void remove(std::vector<Point3> *positions, const Point3 &position) {
+    auto it = std::find(positions->begin(), positions->end(), position);
+    if (it != positions->end()) {
+        *it = positions->back();
+        positions->pop_back();
+    }
+}
+
+void World::remesh_neighborhood(const Point3 &position) {
+    if (chunks.find(position) != nullptr && !contains(remesh, position)) {
+        remesh.push_back(position);
+    }
+    for (const auto &neighbor : Chunk_Neighbors) {
+        auto p = position + neighbor.offset;
+        if (chunks.find(p) != nullptr && !contains(remesh, p)) {
+            remesh.push_back(p);
         }
     }
 }
+
+void World::submit_mesh(Chunk *chunk) {
+    // The job works on a copy so the chunk can be edited or unloaded
+    // while it runs.
+    auto *padded = padded_pool.acquire();
+    chunk->pad(padded);
+
+    // Neighbors at another level of detail are left as air, so both
+    // chunks close their side of the seam
+    int lod = chunk->lod;
+    for (const auto &neighbor : Chunk_Neighbors) {
+        auto *other = chunks.find(chunk->position + neighbor.offset);
+        if (other != nullptr && other->lod == lod) {
+            other->pad_border(neighbor.side, padded, lod);
+        }
+    }
+
+    auto position = chunk->position;
+    auto version = ++chunk->mesh_version;
+    auto mesher = this->mesher;
+
+    jobs.submit([this, padded, position, version, mesher, lod] {
+        // Grows to the largest mesh built on the thread, then the result
+        // is copied into a pooled mesh in one go
+        static thread_local Mesh scratch;
+        if (lod == 0) {
+            build_mesh(*padded, mesher, &scratch);
+        } else {
+            build_lod_mesh(*padded, lod, &scratch);
+        }
+        padded_pool.release(padded);
+
+        auto *mesh = mesh_pool.acquire();
+        mesh->vertices.assign(scratch.vertices.begin(), scratch.vertices.end());
+        std::copy(std::begin(scratch.sections), std::end(scratch.sections), mesh->sections);
+
+        std::lock_guard<std::mutex> lock{completed_mutex};
+        meshed.push_back({position, version, mesh});
+    });
+}
+
+// Rebuilds the load queue and unloads chunks that went out of view. Only
+// runs when the player crosses into another chunk.
+void World::update_center(const Point3 &new_center) {
+    center = new_center;
+    center_valid = true;
+
+    // Unloading is cheap, so everything out of view goes at once
+    out_of_view.clear();
+    for (auto *chunk : chunks) {
+        if (!in_view(chunk->position, view_distance + 1)) {
+            out_of_view.push_back(chunk->position);
+        }
+    }
+    for (const auto &position : out_of_view) {
+        unload(chunks.remove(position));
+        remove(&remesh, position);
+    }
+    // Faces towards the unloaded chunks are visible again
+    for (const auto &position : out_of_view) {
+        remesh_neighborhood(position);
+    }
+
+    // Chunks that crossed into another level of detail, and the
+    // neighbors sharing a seam with them, are meshed again
+    for (auto *chunk : chunks) {
+        int lod = lod_level(chunk->position);
+        if (lod != chunk->lod) {
+            chunk->lod = uint8_t(lod);
+            remesh_neighborhood(chunk->position);
+        }
+    }
+
+    load_queue.clear();
+    for (int x = -view_distance; x <= view_distance; ++x) {
+        for (int z = -view_distance; z <= view_distance; ++z) {
+            auto position = center + Point3(x, 0, z);
+            if (in_view(position, view_distance)
+                    && chunks.find(position) == nullptr
+                    && !contains(pending, position)) {
+                load_queue.push_back(position);
+            }
+        }
+    }
+
+    // Nearest chunks at the back so they are popped first
+    std::sort(load_queue.begin(), load_queue.end(), [this](const Point3 &a, const Point3 &b) {
+        auto da = a - center;
+        auto db = b - center;
+        return da.x * da.x + da.z * da.z > db.x * db.x + db.z * db.z;
+    });
+}
+
+void World::update() {
+    auto player_chunk = Point3(int(floorf((player_position.x + 0.5f) / Chunk_SizeX)), 0,
+                               int(floorf((player_position.z + 0.5f) / Chunk_SizeZ)));
+
+    if (!center_valid || player_chunk != center) {
+        update_center(player_chunk);
+    }
+
+    // Keep the workers busy without queueing far ahead of the player
+    while (!load_queue.empty() && int(pending.size()) < max_pending) {
+        auto position = load_queue.back();
+        load_queue.pop_back();
+        pending.push_back(position);
+
+        jobs.submit([this, position] {
+            // Chunks seen before are read back rather than generated
+            auto *chunk = store.load(position);
+            if (chunk == nullptr) chunk = terrain.generate(position);
+
+            std::lock_guard<std::mutex> lock{completed_mutex};
+            generated.push_back(chunk);
+        });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{completed_mutex};
+
+        for (auto *chunk : generated) {
+            remove(&pending, chunk->position);
+
+            // The player may have moved away while the chunk was generated
+            if (!in_view(chunk->position, view_distance + 1)) {
+                unload(chunk);
+                continue;
+            }
+
+            // Neighbors can now cull the faces they share with the chunk
+            chunk->lod = uint8_t(lod_level(chunk->position));
+            chunks.insert(chunk);
+            remesh_neighborhood(chunk->position);
+        }
+        generated.clear();
+
+        ready.insert(ready.end(), meshed.begin(), meshed.end());
+        meshed.clear();
+    }
+
+    apply_edits();
+
+    for (const auto &position : remesh) {
+        submit_mesh(chunks.find(position));
+    }
+    remesh.clear();
+
+    // Upload the nearest meshes first, within the frame budget
+    std::sort(ready.begin(), ready.end(), [this](const MeshResult &a, const MeshResult &b) {
+        auto da = a.position - center;
+        auto db = b.position - center;
+        return da.x * da.x + da.z * da.z > db.x * db.x + db.z * db.z;
+    });
+
+    int uploads = 0;
+    while (!ready.empty() && uploads < upload_budget) {
+        auto result = ready.back();
+        ready.pop_back();
+
+        // Drop meshes of unloaded chunks and meshes that were superseded
+        // by a newer request.
+        auto *chunk = chunks.find(result.position);
+        if (chunk == nullptr || chunk->mesh_version != result.version) {
+            mesh_pool.release(result.mesh);
+            continue;
+        }
+
+        std::swap(chunk->mesh, *result.mesh);
+        mesh_pool.release(result.mesh);
+        renderer.upload_chunk(chunk);
+        chunk->uploaded_version = result.version;
+        ++uploads;
+    }
+}
+
+Voxel World::get_voxel(const Point3 &position) const {
+    auto *chunk = chunks.find(chunk_position(position));
+    if (chunk == nullptr) return Voxel_Air;
+
+    auto p = local_position(position);
+    return chunk->get(p.x, p.y, p.z);
+}
+
+bool World::set_voxel(const Point3 &position, Voxel voxel) {
+    auto *chunk = chunks.find(chunk_position(position));
+    if (chunk == nullptr) return false;
+
+    auto p = local_position(position);
+    if (chunk->get(p.x, p.y, p.z) == voxel) return true;
+
+    chunk->set(p.x, p.y, p.z, voxel);
+    chunk->saved = false;
+
+    // Sections above and below cull faces against their first and last
+    // layers
+    int section = p.y / Section_Size;
+    int layer = p.y % Section_Size;
+    mark_dirty(chunk, section);
+    if (layer == 0 && section > 0) {
+        mark_dirty(chunk, section - 1);
+    }
+    if (layer == Section_Size - 1 && section < Chunk_Sections - 1) {
+        mark_dirty(chunk, section + 1);
+    }
+
+    // So do neighbors on the chunk border
+    for (const auto &neighbor : Chunk_Neighbors) {
+        auto q = p + neighbor.offset;
+        if (q.x >= 0 && q.x < Chunk_SizeX && q.z >= 0 && q.z < Chunk_SizeZ) continue;
+
+        auto *other = chunks.find(chunk->position + neighbor.offset);
+        if (other != nullptr) mark_dirty(other, section);
+    }
+    return true;
+}
+
+void World::mark_dirty(Chunk *chunk, int section) {
+    if (chunk->dirty_sections == 0) edited.push_back(chunk->position);
+    chunk->dirty_sections |= uint16_t(1 << section);
+}
+
+void World::apply_edits() {
+    for (const auto &position : edited) {
+        auto *chunk = chunks.find(position);
+        if (chunk == nullptr || chunk->dirty_sections == 0) continue;
+
+        uint32_t dirty = chunk->dirty_sections;
+        chunk->dirty_sections = 0;
+
+        // Chunks without a mesh to patch, or whose mesh is about to be
+        // replaced, are meshed again in full. Padding the chunk picks the
+        // edits up.
+        bool patchable = chunk->lod == 0 && chunk->uploaded
+                      && chunk->uploaded_version == chunk->mesh_version;
+        if (!patchable || contains(remesh, position)) {
+            if (!contains(remesh, position)) remesh.push_back(position);
+            continue;
+        }
+
+        patch_mesh(chunk, dirty);
+    }
+    edited.clear();
+}
+
+void World::patch_mesh(Chunk *chunk, uint32_t dirty_sections) {
+    auto *padded = padded_pool.acquire();
+    auto &mesh = chunk->mesh;
+    auto &vertices = mesh.vertices;
+
+    // Vertices of the mesh that changed
+    uint32_t first = UINT32_MAX;
+    uint32_t end = 0;
+
+    for (int s = 0; s < Chunk_Sections; ++s) {
+        if (!(dirty_sections & (1u << s))) continue;
+
+        // Only the layers the section is meshed from are padded, the
+        // borders of neighbors at other levels stay air like in
+        // submit_mesh
+        chunk->pad_section(s, padded);
+        for (const auto &neighbor : Chunk_Neighbors) {
+            auto *other = chunks.find(chunk->position + neighbor.offset);
+            if (other != nullptr && other->lod == 0) {
+                other->pad_section_border(neighbor.side, s, padded);
+            }
+        }
+
+        section_scratch.vertices.clear();
+        build_section_mesh(*padded, s, mesher, &section_scratch);
+        const auto &section = section_scratch.vertices;
+
+        // Replace the section's vertices, shifting the ones after it if
+        // the size changed
+        uint32_t begin = mesh.sections[s];
+        uint32_t old_size = mesh.sections[s + 1] - begin;
+        auto new_size = uint32_t(section.size());
+
+        if (new_size == old_size) {
+            std::copy(section.begin(), section.end(), vertices.begin() + begin);
+            end = math::max(end, begin + new_size);
+        } else {
+            vertices.erase(vertices.begin() + begin, vertices.begin() + begin + old_size);
+            vertices.insert(vertices.begin() + begin, section.begin(), section.end());
+            for (int t = s + 1; t <= Chunk_Sections; ++t) {
+                mesh.sections[t] = mesh.sections[t] - old_size + new_size;
+            }
+            end = uint32_t(vertices.size());
+        }
+        first = math::min(first, begin);
+    }
+
+    padded_pool.release(padded);
+    renderer.update_chunk(chunk, first, end);
+}
+
+bool World::raycast(const Ray &ray, RayHit *hit) const {
+    return ::raycast(chunks, ray, hit);
+}
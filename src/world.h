@@ -2,10 +2,19 @@
 #define WORLD_H
 
 #include <vector>
+#include <string>
+#include <mutex>
 
 #include "chunk.h"
+#include "chunk_map.h"
+#include "mesher.h"
 #include "rendering.h"
 #include "camera.h"
+#include "jobs.h"
+#include "terrain.h"
+#include "region.h"
+#include "pool.h"
+#include "raycast.h"
 
 class World {
 public:
@@ -13,14 +22,135 @@ public:
     Camera camera{Vector3(0.0f, 20.0f, 0.0f)};
     Renderer renderer;
 
-    std::vector<Chunk *> chunks;
+    // The fastest mesher on the mesher_test.cpp benchmark
+    Mesher mesher = Mesher_Binary;
+
+    // Chunks within this many chunks of the player are streamed in.
+    // Chunks are unloaded once they are one chunk further than this.
+    int view_distance = 12;
+
+    // Chunks further than lod_distance[n - 1] chunks from the player are
+    // meshed at level of detail n, see build_lod_mesh
+    int lod_distance[Lod_Levels - 1] = {4, 7, 10};
+
+    // Maximum number of meshes uploaded to the GPU per frame
+    int upload_budget = 4;
+
+    // Maximum number of chunks being generated at once. Keeping this
+    // small lets the load order follow the player as they move.
+    int max_pending = 32;
+
+    // Generates chunks on the workers
+    TerrainGenerator terrain;
+
+    // Chunks are saved here when unloaded and read back instead of
+    // being generated again. Set before load().
+    std::string save_directory = "world";
+    RegionStore store;
+
+    // Chunks that have been generated, keyed by chunk position. A chunk
+    // is only drawn once its first mesh has been uploaded.
+    ChunkMap chunks;
+
+    // Generates and meshes chunks off the main thread
+    JobSystem jobs;
+
+    explicit World(uint64_t seed = 0) : terrain{seed} {}
 
     World(const World &) = delete;
     World& operator=(const World&) = delete;
 
-    ~World() = default;
+    ~World();
 
     void load();
+
+    // Streams chunks in and out around the player. Called once per frame.
+    void update();
+
+    // Returns the voxel at `position` in world voxel coordinates, or
+    // Voxel_Air if the chunk containing it is not loaded.
+    Voxel get_voxel(const Point3 &position) const;
+
+    // Sets the voxel at `position` in world voxel coordinates. Returns
+    // false if the chunk containing it is not loaded.
+    //
+    // Only marks the section of the voxel dirty, along with the sections
+    // culling faces against it in the same chunk or across a chunk
+    // border. Their meshes are rebuilt and patched into the chunk meshes
+    // once per frame by update(), so any number of edits in a frame cost
+    // one rebuild per touched section.
+    bool set_voxel(const Point3 &position, Voxel voxel);
+
+    // Finds the first solid voxel along the ray in the loaded chunks,
+    // such as the voxel under the crosshair with a ray from
+    // camera.position along camera.front. See raycast.
+    bool raycast(const Ray &ray, RayHit *hit) const;
+
+private:
+    struct MeshResult {
+        Point3 position;
+        uint32_t version;
+        // From mesh_pool
+        Mesh *mesh;
+    };
+
+    // Buffers passed to and from the mesh jobs. Uploading swaps the new
+    // mesh with the chunk's old one, which goes back to the pool, so
+    // remeshing reuses the same vertex storage over and over.
+    Pool<PaddedVoxels> padded_pool;
+    Pool<Mesh> mesh_pool;
+
+    // Chunk the player was in when the load queue was last built
+    Point3 center;
+    bool center_valid = false;
+
+    // Chunks waiting to be generated, nearest last
+    std::vector<Point3> load_queue;
+
+    // Scratch for update_center, kept so crossing chunks does not allocate
+    std::vector<Point3> out_of_view;
+
+    // Chunks submitted for generation but not added to `chunks` yet
+    std::vector<Point3> pending;
+
+    // Chunks that need a new mesh this frame
+    std::vector<Point3> remesh;
+
+    // Chunks with dirty sections, see set_voxel
+    std::vector<Point3> edited;
+    Mesh section_scratch;
+
+    // Results from the workers, guarded by `completed_mutex`
+    std::mutex completed_mutex;
+    std::vector<Chunk *> generated;
+    std::vector<MeshResult> meshed;
+
+    // Meshes waiting for upload budget
+    std::vector<MeshResult> ready;
+
+    void update_center(const Point3 &new_center);
+
+    // Saves the chunk if it has unsaved changes, then frees it
+    void unload(Chunk *chunk);
+    bool in_view(const Point3 &position, int distance) const;
+
+    // Level of detail for the chunk at `position`, from its distance to
+    // the player
+    int lod_level(const Point3 &position) const;
+
+    // Queues the chunk and its loaded horizontal neighbors for remeshing
+    void remesh_neighborhood(const Point3 &position);
+
+    // Copies the chunk and the borders of its neighbors and submits a
+    // job to mesh them.
+    void submit_mesh(Chunk *chunk);
+
+    void mark_dirty(Chunk *chunk, int section);
+
+    // Rebuilds the dirty sections of the edited chunks and patches them
+    // into the uploaded meshes
+    void apply_edits();
+    void patch_mesh(Chunk *chunk, uint32_t dirty_sections);
 };
 
 #endif // WORLD_H